@@ -0,0 +1,175 @@
+#include "active.h"
+#include "kernel.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static int rect_unstable(const grid_t *g, int r0, int r1, int c0, int c1)
+{
+    for (int i = r0; i < r1; i++)
+    {
+        const cell_t *row = grid_row(g, i);
+        for (int j = c0; j < c1; j++)
+            if (row[j] >= 4)
+                return 1;
+    }
+    return 0;
+}
+
+int active_init(active_set_t *a, const grid_t *g, int tile_rows, int tile_cols)
+{
+    a->tile_rows = tile_rows;
+    a->tile_cols = tile_cols;
+    a->rows = (g->rows + tile_rows - 1) / tile_rows;
+    a->cols = (g->cols + tile_cols - 1) / tile_cols;
+
+    size_t tiles = (size_t)a->rows * a->cols;
+    a->unstable = calloc(tiles ? tiles : 1, 1);
+    a->stale = malloc(tiles ? tiles : 1);
+    a->forced = calloc(tiles ? tiles : 1, 1);
+    a->spare = calloc(tiles ? tiles : 1, 1);
+    if (!a->unstable || !a->stale || !a->forced || !a->spare)
+    {
+        active_free(a);
+        return -1;
+    }
+
+    // Nothing is known about the other buffer yet, so every tile starts stale
+    memset(a->stale, 1, tiles);
+    for (int ti = 0; ti < a->rows; ti++)
+    {
+        int r0 = ti * tile_rows;
+        int r1 = r0 + tile_rows < g->rows ? r0 + tile_rows : g->rows;
+        for (int tj = 0; tj < a->cols; tj++)
+        {
+            int c0 = tj * tile_cols;
+            int c1 = c0 + tile_cols < g->cols ? c0 + tile_cols : g->cols;
+            a->unstable[(size_t)ti * a->cols + tj] = (unsigned char)rect_unstable(g, r0, r1, c0, c1);
+        }
+    }
+
+    a->box_row_begin = a->box_row_end = a->box_col_begin = a->box_col_end = 0;
+    a->tiles_swept = 0;
+    return 0;
+}
+
+void active_free(active_set_t *a)
+{
+    free(a->unstable);
+    free(a->stale);
+    free(a->forced);
+    free(a->spare);
+    a->unstable = a->stale = a->forced = a->spare = NULL;
+}
+
+void active_scan_ghost(active_set_t *a, const grid_t *g, int ghost_row)
+{
+    if (a->rows == 0)
+        return;
+
+    const cell_t *row = grid_row(g, ghost_row);
+    unsigned char *forced = a->forced + (ghost_row < 0 ? 0 : (size_t)(a->rows - 1) * a->cols);
+    for (int tj = 0; tj < a->cols; tj++)
+    {
+        int c0 = tj * a->tile_cols;
+        int c1 = c0 + a->tile_cols < g->cols ? c0 + a->tile_cols : g->cols;
+        for (int j = c0; j < c1; j++)
+        {
+            if (row[j] >= 4)
+            {
+                forced[tj] = 1;
+                break;
+            }
+        }
+    }
+}
+
+void active_scan_ghost_col(active_set_t *a, const grid_t *g, int ghost_col)
+{
+    if (a->cols == 0)
+        return;
+
+    int tj = ghost_col < 0 ? 0 : a->cols - 1;
+    for (int ti = 0; ti < a->rows; ti++)
+    {
+        int r0 = ti * a->tile_rows;
+        int r1 = r0 + a->tile_rows < g->rows ? r0 + a->tile_rows : g->rows;
+        for (int i = r0; i < r1; i++)
+        {
+            if (GRID_AT(g, i, ghost_col) >= 4)
+            {
+                a->forced[(size_t)ti * a->cols + tj] = 1;
+                break;
+            }
+        }
+    }
+}
+
+long active_sweep(active_set_t *a, const grid_t *cur, grid_t *next)
+{
+    long topples = 0, swept = 0;
+    int box_r0 = cur->rows, box_r1 = 0, box_c0 = cur->cols, box_c1 = 0;
+
+    // Tiles are independent within a sweep; builds with OpenMP share them out
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(dynamic) reduction(+:topples, swept) \
+        reduction(min:box_r0, box_c0) reduction(max:box_r1, box_c1)
+#endif
+    for (int ti = 0; ti < a->rows; ti++)
+    {
+        int r0 = ti * a->tile_rows;
+        int r1 = r0 + a->tile_rows < cur->rows ? r0 + a->tile_rows : cur->rows;
+        for (int tj = 0; tj < a->cols; tj++)
+        {
+            int c0 = tj * a->tile_cols;
+            int c1 = c0 + a->tile_cols < cur->cols ? c0 + a->tile_cols : cur->cols;
+            size_t t = (size_t)ti * a->cols + tj;
+
+            // Grains only cross into a tile from an unstable tile next to it
+            int active = a->unstable[t] || a->forced[t] ||
+                         (ti > 0 && a->unstable[t - a->cols]) ||
+                         (ti < a->rows - 1 && a->unstable[t + a->cols]) ||
+                         (tj > 0 && a->unstable[t - 1]) ||
+                         (tj < a->cols - 1 && a->unstable[t + 1]);
+
+            if (active)
+            {
+                int unstable = 0;
+                topples += sandpile_sweep(cur, next, r0, r1, c0, c1, &unstable);
+                a->spare[t] = (unsigned char)unstable;
+                a->stale[t] = 1;
+                swept++;
+
+                box_r0 = r0 < box_r0 ? r0 : box_r0;
+                box_r1 = r1 > box_r1 ? r1 : box_r1;
+                box_c0 = c0 < box_c0 ? c0 : box_c0;
+                box_c1 = c1 > box_c1 ? c1 : box_c1;
+            }
+            else
+            {
+                // A quiet tile maps onto itself; sync the other buffer once
+                if (a->stale[t])
+                {
+                    for (int i = r0; i < r1; i++)
+                        memcpy(grid_row(next, i) + c0, grid_row(cur, i) + c0, (size_t)(c1 - c0) * sizeof(cell_t));
+                    a->stale[t] = 0;
+                }
+                a->spare[t] = 0;
+            }
+        }
+    }
+
+    unsigned char *tmp = a->unstable;
+    a->unstable = a->spare;
+    a->spare = tmp;
+    memset(a->forced, 0, (size_t)a->rows * a->cols);
+
+    if (box_r1 == 0)
+        box_r0 = box_c0 = 0;
+    a->box_row_begin = box_r0;
+    a->box_row_end = box_r1;
+    a->box_col_begin = box_c0;
+    a->box_col_end = box_c1;
+    a->tiles_swept = swept;
+    return topples;
+}
@@ -0,0 +1,49 @@
+/*
+ * Active-region Jacobi sweeps.
+ *
+ * The grid is split into tiles and each tile keeps two flags: whether it holds
+ * an unstable cell, and whether the two Jacobi buffers still differ inside it.
+ * A tile is recomputed only if it or one of its four neighbouring tiles is
+ * unstable; a quiet tile is copied once to bring the other buffer up to date
+ * and is not touched again until activity reaches it. Work per sweep therefore
+ * follows the avalanche instead of the grid area, while the result stays
+ * identical to the full sweep.
+ */
+
+#ifndef SANDPILE_ACTIVE_H
+#define SANDPILE_ACTIVE_H
+
+#include "grid.h"
+
+#define ACTIVE_TILE_ROWS 16
+#define ACTIVE_TILE_COLS 128
+
+typedef struct
+{
+    int tile_rows, tile_cols; // tile size in cells
+    int rows, cols;           // number of tiles per dimension
+    unsigned char *unstable;  // tile holds a cell >= 4 in the current buffer
+    unsigned char *stale;     // tile differs between the current and next buffers
+    unsigned char *forced;    // tile must be swept next time (ghost row activity)
+    unsigned char *spare;     // scratch for the next unstable flags
+
+    // Cell bounding box of the tiles swept by the last call, empty if none
+    int box_row_begin, box_row_end, box_col_begin, box_col_end;
+    long tiles_swept;
+} active_set_t;
+
+// Builds the tile flags for the current contents of g. Returns 0 on success.
+int active_init(active_set_t *a, const grid_t *g, int tile_rows, int tile_cols);
+void active_free(active_set_t *a);
+
+// Marks the tiles next to a ghost row (-1 or g->rows) for the next sweep if
+// that row holds an unstable cell.
+void active_scan_ghost(active_set_t *a, const grid_t *g, int ghost_row);
+// Same for a ghost column (-1 or g->cols).
+void active_scan_ghost_col(active_set_t *a, const grid_t *g, int ghost_col);
+
+// One Jacobi sweep of cur into next restricted to active tiles. Returns the
+// number of topples; the caller swaps the buffers afterwards as usual.
+long active_sweep(active_set_t *a, const grid_t *cur, grid_t *next);
+
+#endif
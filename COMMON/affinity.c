@@ -0,0 +1,170 @@
+// sched_setaffinity and the CPU_* macros
+#define _GNU_SOURCE
+
+#include "affinity.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __linux__
+#include <sched.h>
+#endif
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+static const char *const names[] = {"none", "close", "spread"};
+
+int affinity_parse(const char *name)
+{
+    for (int k = 0; k < 3; k++)
+        if (strcmp(name, names[k]) == 0)
+            return k;
+    return -1;
+}
+
+const char *affinity_name(int policy)
+{
+    return policy >= 0 && policy < 3 ? names[policy] : "unknown";
+}
+
+#ifdef __linux__
+
+// CPUs of the calling thread's current mask, in order
+static int current_cpus(int *cpus, int max)
+{
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof set, &set) != 0)
+        return 0;
+    int n = 0;
+    for (int c = 0; c < CPU_SETSIZE && n < max; c++)
+        if (CPU_ISSET(c, &set))
+            cpus[n++] = c;
+    return n;
+}
+
+static int bind_cpus(const int *cpus, int count)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int k = 0; k < count; k++)
+        CPU_SET(cpus[k], &set);
+    return sched_setaffinity(0, sizeof set, &set) == 0 ? 0 : -1;
+}
+
+int affinity_bind_process(int policy, int slot, int slots, int width)
+{
+    if (policy == AFFINITY_NONE)
+        return 0;
+    if (slots < 1 || slot < 0 || slot >= slots)
+        return -1;
+
+    // Shares are taken from the inherited mask, so a launcher's or batch
+    // system's CPU set is narrowed, never left
+    int *cpus = malloc(CPU_SETSIZE * sizeof *cpus);
+    int n = cpus ? current_cpus(cpus, CPU_SETSIZE) : 0;
+    if (n == 0)
+    {
+        free(cpus);
+        return -1;
+    }
+
+    int first, count;
+    if (policy == AFFINITY_CLOSE)
+    {
+        first = (int)(((long)slot * width) % n);
+        count = width < n ? width : n;
+        if (first + count > n)
+            first = n - count;
+    }
+    else
+    {
+        // Every process gets at least one CPU; with more processes than CPUs
+        // they share
+        first = (int)((long)slot * n / slots);
+        count = (int)((long)(slot + 1) * n / slots) - first;
+        if (count < 1)
+            count = 1;
+        if (first >= n)
+            first = n - 1;
+    }
+    int status = bind_cpus(cpus + first, count);
+    free(cpus);
+    return status;
+}
+
+int affinity_bind_threads(int policy, char *desc, size_t size)
+{
+    snprintf(desc, size, "not pinned");
+    if (policy == AFFINITY_NONE)
+        return 0;
+#ifdef _OPENMP
+    const char *bind = getenv("OMP_PROC_BIND");
+    if (bind && *bind)
+    {
+        snprintf(desc, size, "left to OMP_PROC_BIND=%s", bind);
+        return -1;
+    }
+#endif
+
+    int *cpus = malloc(CPU_SETSIZE * sizeof *cpus);
+    int n = cpus ? current_cpus(cpus, CPU_SETSIZE) : 0;
+    if (n == 0)
+    {
+        free(cpus);
+        return -1;
+    }
+
+    int threads = 1;
+#ifdef _OPENMP
+    threads = omp_get_max_threads();
+#endif
+    int *placed = malloc((size_t)threads * sizeof *placed);
+    int failed = !placed;
+    if (!failed)
+    {
+#ifdef _OPENMP
+#pragma omp parallel reduction(| : failed)
+#endif
+        {
+#ifdef _OPENMP
+            int t = omp_get_thread_num();
+            int team = omp_get_num_threads();
+#else
+            int t = 0, team = 1;
+#endif
+            // More threads than CPUs wrap around
+            int k = policy == AFFINITY_CLOSE ? t % n : (int)((long)t * n / team) % n;
+            placed[t] = cpus[k];
+            failed |= bind_cpus(&cpus[k], 1) != 0;
+        }
+    }
+
+    if (!failed)
+    {
+        size_t used = 0;
+        for (int t = 0; t < threads && used < size; t++)
+            used += (size_t)snprintf(desc + used, size - used, "%s%d", t ? "," : "", placed[t]);
+    }
+    free(placed);
+    free(cpus);
+    return failed ? -1 : 0;
+}
+
+#else
+
+int affinity_bind_process(int policy, int slot, int slots, int width)
+{
+    (void)slot;
+    (void)slots;
+    (void)width;
+    return policy == AFFINITY_NONE ? 0 : -1;
+}
+
+int affinity_bind_threads(int policy, char *desc, size_t size)
+{
+    snprintf(desc, size, "not pinned");
+    return policy == AFFINITY_NONE ? 0 : -1;
+}
+
+#endif
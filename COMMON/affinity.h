@@ -0,0 +1,46 @@
+/*
+ * Thread and process pinning (--affinity=none|close|spread).
+ *
+ * OpenMP threads are pinned to the CPUs the process may run on: "close" puts
+ * thread t on the t-th of them, filling one socket before the next, "spread"
+ * spaces the threads evenly over all of them so both sockets of a node and
+ * their memory controllers are used from the first threads on. MPI ranks get
+ * a block of the CPUs they were started with: consecutive blocks of one CPU per thread
+ * for "close", that set split evenly between the ranks on the node for
+ * "spread".
+ * "none" leaves placement to the OS, mpirun or OMP_PROC_BIND. Together with
+ * grid_alloc_first_touch this keeps every thread on the memory it sweeps.
+ *
+ * Pinning uses sched_setaffinity and is Linux only; elsewhere every policy
+ * falls back to "none".
+ */
+
+#ifndef SANDPILE_AFFINITY_H
+#define SANDPILE_AFFINITY_H
+
+#include <stddef.h>
+
+enum
+{
+    AFFINITY_NONE,
+    AFFINITY_CLOSE,
+    AFFINITY_SPREAD
+};
+
+// Policy named by "none", "close" or "spread", or -1.
+int affinity_parse(const char *name);
+const char *affinity_name(int policy);
+
+// Pins the calling process to its share of the CPUs it inherited as the
+// slot-th of `slots` processes with `width` threads each. Returns 0 on
+// success, -1 if the policy could not be applied.
+int affinity_bind_process(int policy, int slot, int slots, int width);
+
+// Pins every thread of an OpenMP team of the current size to one CPU of the
+// process's CPU set and describes the result ("0,2,4,6", or why nothing was
+// done) in desc. The runtime keeps its pool of threads between parallel
+// regions, so the pinning carries over to the solver's own regions. Returns 0
+// on success, -1 if the policy could not be applied.
+int affinity_bind_threads(int policy, char *desc, size_t size);
+
+#endif
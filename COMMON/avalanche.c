@@ -0,0 +1,161 @@
+// getline under -std=c11
+#define _POSIX_C_SOURCE 200809L
+
+#include "avalanche.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+int avalanche_init(avalanche_t *a, grid_t *g)
+{
+    long cells = (long)g->rows * g->cols;
+    a->grid = g;
+    a->capacity = cells + 1;
+    a->queue = malloc((size_t)a->capacity * sizeof *a->queue);
+    a->stamp = calloc((size_t)(g->rows + 2) * g->stride, sizeof *a->stamp);
+    a->event = 0;
+    if (!a->queue || !a->stamp)
+    {
+        avalanche_free(a);
+        return -1;
+    }
+    return 0;
+}
+
+void avalanche_free(avalanche_t *a)
+{
+    free(a->queue);
+    free(a->stamp);
+    a->queue = NULL;
+    a->stamp = NULL;
+}
+
+int avalanche_drop(avalanche_t *a, const avalanche_drop_t *drops, int n, avalanche_stats_t *stats)
+{
+    grid_t *g = a->grid;
+    for (int k = 0; k < n; k++)
+    {
+        const avalanche_drop_t *d = &drops[k];
+        if (d->row < 0 || d->row >= g->rows || d->col < 0 || d->col >= g->cols || d->grains < 0)
+            return -1;
+    }
+
+    // Cells are addressed by their offset from the first border row, so the
+    // stamps line up with the grid and the border cells can be recognised
+    cell_t *base = grid_row(g, -1) - 1;
+    long stride = g->stride;
+    long head = 0, tail = 0;
+    for (int k = 0; k < n; k++)
+    {
+        cell_t *cell = &GRID_AT(g, drops[k].row, drops[k].col);
+        if ((long)*cell + drops[k].grains > CELL_SAFE)
+        {
+            // Several drops on one cell add up; take the applied ones back
+            while (k-- > 0)
+                GRID_AT(g, drops[k].row, drops[k].col) -= (cell_t)drops[k].grains;
+            return -1;
+        }
+        if (*cell < 4 && *cell + drops[k].grains >= 4)
+        {
+            a->queue[tail] = cell - base;
+            tail = tail + 1 == a->capacity ? 0 : tail + 1;
+        }
+        *cell += (cell_t)drops[k].grains;
+    }
+
+    if (++a->event == 0)
+    {
+        // Stamps wrapped around; forget the old ones
+        for (long k = 0; k < (long)(g->rows + 2) * stride; k++)
+            a->stamp[k] = 0;
+        a->event = 1;
+    }
+
+    avalanche_stats_t s = {0, 0, 0};
+    while (head != tail)
+    {
+        // One generation: the cells queued so far
+        long end = tail;
+        s.duration++;
+        while (head != end)
+        {
+            long offset = a->queue[head];
+            head = head + 1 == a->capacity ? 0 : head + 1;
+            cell_t *cell = base + offset;
+            cell_t distribute = *cell >> 2;
+            *cell &= 3;
+            s.size += distribute;
+            if (a->stamp[offset] != a->event)
+            {
+                a->stamp[offset] = a->event;
+                s.area++;
+            }
+
+            // Neighbours in the border are the sink; their grains are dropped
+            long i = offset / stride, j = offset % stride;
+            long neighbours[4];
+            int count = 0;
+            if (i > 1)
+                neighbours[count++] = offset - stride;
+            if (i < g->rows)
+                neighbours[count++] = offset + stride;
+            if (j > 1)
+                neighbours[count++] = offset - 1;
+            if (j < g->cols)
+                neighbours[count++] = offset + 1;
+            for (int k = 0; k < count; k++)
+            {
+                cell_t *next = base + neighbours[k];
+                if (*next < 4 && *next + distribute >= 4)
+                {
+                    a->queue[tail] = neighbours[k];
+                    tail = tail + 1 == a->capacity ? 0 : tail + 1;
+                }
+                *next += distribute;
+            }
+        }
+    }
+
+    *stats = s;
+    return 0;
+}
+
+int avalanche_read_event(FILE *input, avalanche_drop_t **drops, int *capacity)
+{
+    char *line = NULL;
+    size_t size = 0;
+    int n = 0;
+    while (n == 0 && getline(&line, &size, input) >= 0)
+    {
+        char *token = line + strspn(line, " \t\r\n");
+        if (*token == '#')
+            continue;
+        for (; *token; token += strspn(token, " \t\r\n"))
+        {
+            avalanche_drop_t d = {0, 0, 1};
+            int used = 0;
+            if (sscanf(token, "%d,%d%n,%d%n", &d.row, &d.col, &used, &d.grains, &used) < 2 ||
+                (token[used] && !strchr(" \t\r\n", token[used])))
+            {
+                free(line);
+                return -1;
+            }
+            token += used;
+            if (n == *capacity)
+            {
+                int grown = *capacity ? 2 * *capacity : 16;
+                avalanche_drop_t *more = realloc(*drops, (size_t)grown * sizeof *more);
+                if (!more)
+                {
+                    free(line);
+                    return -1;
+                }
+                *drops = more;
+                *capacity = grown;
+            }
+            (*drops)[n++] = d;
+        }
+    }
+    free(line);
+    return n;
+}
@@ -0,0 +1,63 @@
+/*
+ * Incremental avalanches on a stable grid.
+ *
+ * Grains dropped onto a stable grid only disturb the cells they make unstable
+ * and whatever those topple onto, so instead of sweeping the whole grid each
+ * drop is resolved with a FIFO of unstable cells: a cell is queued when it
+ * reaches 4 grains and topples fully when it is taken out, queueing the
+ * neighbours it lifts to 4. Work is proportional to the avalanche. Grains that
+ * leave the grid fall into the sink and the border stays zero.
+ *
+ * Each avalanche is measured by its size (topples), its area (distinct cells
+ * that toppled) and its duration (generations of the queue: the dropped cells
+ * are generation 1, cells they make unstable generation 2 and so on, which is
+ * the number of parallel update steps the avalanche would take).
+ */
+
+#ifndef SANDPILE_AVALANCHE_H
+#define SANDPILE_AVALANCHE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "grid.h"
+
+typedef struct
+{
+    int row, col;
+    int grains;
+} avalanche_drop_t;
+
+typedef struct
+{
+    long size;    // topples
+    long area;    // distinct cells that toppled
+    long duration; // queue generations
+} avalanche_stats_t;
+
+typedef struct
+{
+    grid_t *grid;     // resident grid, stable between events
+    long *queue;      // ring of unstable cell offsets; a cell is queued at most once
+    long capacity;
+    uint32_t *stamp;  // event number that last toppled each cell, for the area
+    uint32_t event;
+} avalanche_t;
+
+// Prepares a for events on g, which must be stable (cells 0..3) with a zero
+// border and stays owned by the caller. Returns 0, or -1 if memory ran out.
+int avalanche_init(avalanche_t *a, grid_t *g);
+void avalanche_free(avalanche_t *a);
+
+// Adds the n drops of one event and relaxes the grid back to stability,
+// filling *stats. Returns -1, changing nothing, if a drop is outside the grid
+// or the event's drops on a cell add up to more than CELL_SAFE; 0 otherwise.
+int avalanche_drop(avalanche_t *a, const avalanche_drop_t *drops, int n, avalanche_stats_t *stats);
+
+// Reads the next event from an event file: one line of whitespace separated
+// drops "row,col" or "row,col,grains" (0-based, one grain by default). Blank
+// lines and lines starting with # are skipped. *drops is grown as needed and
+// *capacity tracks its length. Returns the number of drops, 0 at the end of
+// the input and -1 on a malformed line.
+int avalanche_read_event(FILE *input, avalanche_drop_t **drops, int *capacity);
+
+#endif
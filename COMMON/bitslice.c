@@ -0,0 +1,120 @@
+#include "bitslice.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Word w of row i of a plane; rows -1 and `rows` and words -1 and `words` are zero
+static inline uint64_t *plane_row(const bitslice_t *b, uint64_t *plane, int i)
+{
+    return plane + (size_t)(i + 1) * (b->words + 2) + 1;
+}
+
+int bitslice_fits(const grid_t *g)
+{
+    for (int i = 0; i < g->rows; i++)
+    {
+        const cell_t *row = grid_row(g, i);
+        int spill = 0;
+        for (int j = 0; j < g->cols; j++)
+            spill |= row[j] >> 3;
+        if (spill)
+            return 0;
+    }
+    return 1;
+}
+
+int bitslice_init(bitslice_t *b, const grid_t *g)
+{
+    b->rows = g->rows;
+    b->cols = g->cols;
+    b->words = (g->cols + 63) / 64;
+    b->plane_words = (size_t)(b->rows + 2) * (b->words + 2);
+    b->cur = calloc(6 * b->plane_words, sizeof(uint64_t));
+    if (!b->cur)
+        return -1;
+    b->next = b->cur + 3 * b->plane_words;
+
+    for (int i = 0; i < g->rows; i++)
+    {
+        const cell_t *row = grid_row(g, i);
+        for (int k = 0; k < 3; k++)
+        {
+            uint64_t *bits = plane_row(b, b->cur + k * b->plane_words, i);
+            for (int j = 0; j < g->cols; j++)
+                bits[j >> 6] |= (uint64_t)((row[j] >> k) & 1) << (j & 63);
+        }
+    }
+    return 0;
+}
+
+void bitslice_free(bitslice_t *b)
+{
+    free(b->cur < b->next ? b->cur : b->next);
+    b->cur = b->next = NULL;
+}
+
+long bitslice_sweep(bitslice_t *b)
+{
+    int words = b->words;
+    // Padding bits past the last column act as sink and must stay zero
+    uint64_t last_mask = b->cols % 64 ? ((uint64_t)1 << (b->cols % 64)) - 1 : ~(uint64_t)0;
+    long topples = 0;
+
+    for (int i = 0; i < b->rows; i++)
+    {
+        const uint64_t *g0 = plane_row(b, b->cur, i);
+        const uint64_t *g1 = plane_row(b, b->cur + b->plane_words, i);
+        const uint64_t *top = plane_row(b, b->cur + 2 * b->plane_words, i);
+        const uint64_t *top_up = plane_row(b, b->cur + 2 * b->plane_words, i - 1);
+        const uint64_t *top_down = plane_row(b, b->cur + 2 * b->plane_words, i + 1);
+        uint64_t *r0 = plane_row(b, b->next, i);
+        uint64_t *r1 = plane_row(b, b->next + b->plane_words, i);
+        uint64_t *r2 = plane_row(b, b->next + 2 * b->plane_words, i);
+
+        for (int w = 0; w < words; w++)
+        {
+            uint64_t u = top_up[w], d = top_down[w];
+            // Cell j's left neighbour is bit j - 1, its right neighbour bit j + 1
+            uint64_t l = top[w] << 1 | top[w - 1] >> 63;
+            uint64_t r = top[w] >> 1 | top[w + 1] << 63;
+
+            // Count the four incoming grains: k2 k1 k0 in 0..4
+            uint64_t s_ud = u ^ d, c_ud = u & d;
+            uint64_t s_lr = l ^ r, c_lr = l & r;
+            uint64_t k0 = s_ud ^ s_lr;
+            uint64_t k1 = c_ud ^ c_lr ^ (s_ud & s_lr);
+            uint64_t k2 = c_ud & c_lr;
+
+            // Add the two bits the cell keeps; the sum is at most 7
+            uint64_t carry0 = g0[w] & k0;
+            uint64_t carry1 = (g1[w] & k1) | (carry0 & (g1[w] ^ k1));
+            uint64_t mask = w == words - 1 ? last_mask : ~(uint64_t)0;
+            r0[w] = (g0[w] ^ k0) & mask;
+            r1[w] = (g1[w] ^ k1 ^ carry0) & mask;
+            r2[w] = (k2 ^ carry1) & mask;
+
+            topples += __builtin_popcountll(top[w]);
+        }
+    }
+
+    uint64_t *tmp = b->cur;
+    b->cur = b->next;
+    b->next = tmp;
+    return topples;
+}
+
+void bitslice_store(const bitslice_t *b, grid_t *g)
+{
+    for (int i = 0; i < b->rows; i++)
+    {
+        const uint64_t *g0 = plane_row(b, b->cur, i);
+        const uint64_t *g1 = plane_row(b, b->cur + b->plane_words, i);
+        const uint64_t *g2 = plane_row(b, b->cur + 2 * b->plane_words, i);
+        cell_t *row = grid_row(g, i);
+        for (int j = 0; j < b->cols; j++)
+        {
+            int w = j >> 6, s = j & 63;
+            row[j] = (cell_t)((g0[w] >> s & 1) | (g1[w] >> s & 1) << 1 | (g2[w] >> s & 1) << 2);
+        }
+    }
+}
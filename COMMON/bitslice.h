@@ -0,0 +1,39 @@
+/*
+ * Bit-sliced Jacobi sweeps for grids whose cells are all below 8.
+ *
+ * A cell below 8 fits in 3 bits, so the grid is stored as three bit-planes:
+ * one 64-bit word per plane per 64 cells of a row. With every neighbour below
+ * 8 its spill (n >> 2) is just its top bit, so a sweep is
+ *
+ *     next = (g & 3) + top(up) + top(down) + top(left) + top(right)
+ *
+ * evaluated with bitwise adders on 64 cells at a time. The result is at most
+ * 3 + 4 = 7, so the grid never leaves the representation once it is in it.
+ */
+
+#ifndef SANDPILE_BITSLICE_H
+#define SANDPILE_BITSLICE_H
+
+#include <stdint.h>
+#include "grid.h"
+
+typedef struct
+{
+    int rows, cols;
+    int words;          // 64-cell words per row
+    size_t plane_words; // words per plane, zero border rows and words included
+    uint64_t *cur, *next; // three consecutive planes each: bits 0, 1 and 2
+} bitslice_t;
+
+// Returns 1 if every interior cell of g is below 8.
+int bitslice_fits(const grid_t *g);
+// Packs g, which must fit, into bit-planes. Returns 0 on success.
+int bitslice_init(bitslice_t *b, const grid_t *g);
+void bitslice_free(bitslice_t *b);
+
+// One Jacobi sweep; returns the number of topples.
+long bitslice_sweep(bitslice_t *b);
+// Unpacks the planes into the interior of g.
+void bitslice_store(const bitslice_t *b, grid_t *g);
+
+#endif
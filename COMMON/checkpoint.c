@@ -0,0 +1,65 @@
+#include "checkpoint.h"
+#include "grid_bin.h"
+#include "options.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void checkpoint_init(checkpoint_t *c, int argc, char *argv[])
+{
+    c->path = opt_string(argc, argv, "checkpoint", CHECKPOINT_DEFAULT_PATH);
+    c->every = opt_long(argc, argv, "checkpoint-every", 0);
+    c->seconds = opt_double(argc, argv, "checkpoint-seconds", 0.0);
+    c->restart = opt_flag(argc, argv, "restart");
+    if (c->every < 0 || c->seconds < 0.0)
+    {
+        fprintf(stderr, "Checkpoint intervals must not be negative\n");
+        exit(EXIT_FAILURE);
+    }
+
+    c->tmp_path = malloc(strlen(c->path) + 5);
+    if (!c->tmp_path)
+    {
+        fprintf(stderr, "Checkpoint path allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    sprintf(c->tmp_path, "%s.tmp", c->path);
+    checkpoint_mark(c, 0, 0.0);
+}
+
+void checkpoint_free(checkpoint_t *c)
+{
+    free(c->tmp_path);
+    c->tmp_path = NULL;
+}
+
+bool checkpoint_due(const checkpoint_t *c, long sweeps, double now)
+{
+    return (c->every > 0 && sweeps - c->last_sweep >= c->every) ||
+           (c->seconds > 0.0 && now - c->last_time >= c->seconds);
+}
+
+void checkpoint_mark(checkpoint_t *c, long sweeps, double now)
+{
+    c->last_sweep = sweeps;
+    c->last_time = now;
+}
+
+int checkpoint_save(const checkpoint_t *c, const grid_t *g, uint64_t iteration)
+{
+    FILE *output = fopen(c->tmp_path, "wb");
+    if (!output)
+        return -1;
+
+    // Unstable cells can hold anything up to CELL_MAX, so keep the full width
+    int status = grid_bin_write(g, output, (int)sizeof(cell_t), iteration);
+    if (fclose(output) != 0)
+        status = -1;
+    return status == 0 ? checkpoint_commit(c) : -1;
+}
+
+int checkpoint_commit(const checkpoint_t *c)
+{
+    return rename(c->tmp_path, c->path) == 0 ? 0 : -1;
+}
@@ -0,0 +1,53 @@
+/*
+ * Periodic checkpoints of a running stabilization.
+ *
+ * A checkpoint is the current grid in the binary format (grid_bin.h) with
+ * full-width cells and the number of sweeps applied so far in the header's
+ * iteration field. Every intermediate grid relaxes to the same stable grid,
+ * so a checkpoint is simply a new starting grid: it can be resumed by any
+ * driver and, for MPI, on any number of ranks. Files are written under a
+ * temporary name and renamed into place, so an interrupted write never
+ * destroys the previous checkpoint.
+ *
+ *   --checkpoint=path        checkpoint file (default checkpoint.spg)
+ *   --checkpoint-every=N     write one every N sweeps
+ *   --checkpoint-seconds=T   write one every T seconds of wall time
+ *   --restart                start from the checkpoint instead of the input
+ */
+
+#ifndef SANDPILE_CHECKPOINT_H
+#define SANDPILE_CHECKPOINT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "grid.h"
+
+#define CHECKPOINT_DEFAULT_PATH "checkpoint.spg"
+
+typedef struct
+{
+    const char *path;
+    char *tmp_path;   // path the next checkpoint is written to before the rename
+    long every;       // sweeps between checkpoints, 0 for none
+    double seconds;   // wall time between checkpoints, 0 for none
+    bool restart;     // --restart was given
+    long last_sweep;  // sweep count and time of the last checkpoint
+    double last_time;
+} checkpoint_t;
+
+// Reads the options above. Exits on malformed values. The intervals count
+// from the first checkpoint_mark, made when the run starts.
+void checkpoint_init(checkpoint_t *c, int argc, char *argv[]);
+void checkpoint_free(checkpoint_t *c);
+
+// True if an interval has passed since the last checkpoint.
+bool checkpoint_due(const checkpoint_t *c, long sweeps, double now);
+// Restarts both intervals; called whenever a checkpoint has been written.
+void checkpoint_mark(checkpoint_t *c, long sweeps, double now);
+
+// Writes g to the temporary path and renames it into place. Returns 0 on success.
+int checkpoint_save(const checkpoint_t *c, const grid_t *g, uint64_t iteration);
+// Renames a file already written to tmp_path into place. Returns 0 on success.
+int checkpoint_commit(const checkpoint_t *c);
+
+#endif
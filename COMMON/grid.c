@@ -0,0 +1,411 @@
+// fileno, mmap and posix_madvise under -std=c11
+#define _POSIX_C_SOURCE 200809L
+
+#include "grid.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+int grid_stride(int cols)
+{
+    // Round the row length up to whole cache lines so every row starts aligned
+    int per_line = GRID_ALIGN / (int)sizeof(cell_t);
+    return (cols + 2 + per_line - 1) / per_line * per_line;
+}
+
+int grid_alloc(grid_t *g, int rows, int cols)
+{
+    return grid_alloc_halo(g, rows, cols, 1);
+}
+
+// Allocates the buffer without touching it
+static int grid_reserve(grid_t *g, int rows, int cols, int halo)
+{
+    int stride = grid_stride(cols);
+    g->rows = rows;
+    g->cols = cols;
+    g->halo = halo;
+    g->stride = stride;
+    g->data = aligned_alloc(GRID_ALIGN, (size_t)(rows + 2 * halo) * stride * sizeof(cell_t));
+    return g->data ? 0 : -1;
+}
+
+int grid_alloc_halo(grid_t *g, int rows, int cols, int halo)
+{
+    if (grid_reserve(g, rows, cols, halo) != 0)
+        return -1;
+    grid_clear(g);
+    return 0;
+}
+
+int grid_alloc_first_touch(grid_t *g, int rows, int cols, int halo)
+{
+    if (grid_reserve(g, rows, cols, halo) != 0)
+        return -1;
+
+    // A page is placed on the NUMA node of the thread that writes it first
+    long total = rows + 2L * halo;
+    size_t row_bytes = (size_t)g->stride * sizeof(cell_t);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+    for (long i = 0; i < total; i++)
+        memset(g->data + i * g->stride, 0, row_bytes);
+    return 0;
+}
+
+void grid_free(grid_t *g)
+{
+    free(g->data);
+    g->data = NULL;
+}
+
+void grid_clear(grid_t *g)
+{
+    memset(g->data, 0, (size_t)(g->rows + 2 * g->halo) * g->stride * sizeof(cell_t));
+}
+
+void grid_clear_border(grid_t *g)
+{
+    size_t halo_bytes = (size_t)g->halo * g->stride * sizeof(cell_t);
+    memset(g->data, 0, halo_bytes);
+    memset(grid_row(g, g->rows) - 1, 0, halo_bytes);
+    for (int i = 0; i < g->rows; i++)
+    {
+        GRID_AT(g, i, -1) = 0;
+        GRID_AT(g, i, g->cols) = 0;
+    }
+}
+
+void grid_swap(grid_t *a, grid_t *b)
+{
+    grid_t tmp = *a;
+    *a = *b;
+    *b = tmp;
+}
+
+// Hand-rolled text parsing. Rows are parsed line by line straight out of the
+// mapped file; line i must hold exactly the cols values of row i. Anything
+// else (rows wrapped over several lines, blank lines in between) falls back
+// to reading rows * cols whitespace separated values in order, as fscanf would.
+
+#define TEXT_CHUNK_BYTES (1 << 20)
+
+// Rows of ints `stride` apart that the parser fills: the grid itself, or a
+// packed wide copy when cells are narrower than int
+typedef struct
+{
+    int *base;
+    size_t stride;
+    int rows, cols;
+} text_target_t;
+
+static inline int *target_row(const text_target_t *t, long i)
+{
+    return t->base + (size_t)i * t->stride;
+}
+
+static inline int is_blank(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+// Parses one integer at p; returns the position after it, or NULL if p does not start one.
+static const char *parse_int(const char *p, const char *end, int *value)
+{
+    int negative = 0;
+    if (p < end && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+    if (p == end || (unsigned)(*p - '0') > 9)
+        return NULL;
+
+    int v = 0;
+    while (p < end && (unsigned)(*p - '0') <= 9)
+        v = v * 10 + (*p++ - '0');
+    *value = negative ? -v : v;
+    return p;
+}
+
+// Parses the line at p into n values; returns the start of the next line or NULL.
+static const char *parse_line(const char *p, const char *end, int *row, int n)
+{
+    for (int j = 0; j < n; j++)
+    {
+        while (p < end && is_blank(*p))
+            p++;
+        if (!(p = parse_int(p, end, &row[j])))
+            return NULL;
+    }
+    while (p < end && is_blank(*p))
+        p++;
+    if (p < end && *p != '\n')
+        return NULL;
+    return p < end ? p + 1 : p;
+}
+
+static int parse_lines(const text_target_t *g, const char *text, size_t size)
+{
+    long chunks = (long)(size / TEXT_CHUNK_BYTES) + 1;
+#ifdef _OPENMP
+    if (chunks > omp_get_max_threads())
+        chunks = omp_get_max_threads();
+#else
+    chunks = 1;
+#endif
+
+    // Newlines per chunk, turned into the index of the first line of each chunk
+    long *first_line = calloc(chunks + 1, sizeof *first_line);
+    if (!first_line)
+        return -1;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+    for (long c = 0; c < chunks; c++)
+    {
+        const char *p = text + size * c / chunks;
+        const char *end = text + size * (c + 1) / chunks;
+        long count = 0;
+        while ((p = memchr(p, '\n', end - p)))
+        {
+            count++;
+            p++;
+        }
+        first_line[c + 1] = count;
+    }
+    for (long c = 0; c < chunks; c++)
+        first_line[c + 1] += first_line[c];
+
+    long lines = first_line[chunks] + (text[size - 1] != '\n');
+    int failed = lines < g->rows;
+
+    // Each chunk parses the lines that start inside it
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) reduction(| : failed)
+#endif
+    for (long c = 0; c < chunks; c++)
+    {
+        const char *begin = text + size * c / chunks;
+        const char *end = text + size * (c + 1) / chunks;
+        const char *p = begin;
+        long line = first_line[c];
+        if (c > 0 && begin[-1] != '\n')
+        {
+            p = memchr(begin, '\n', end - begin);
+            p = p ? p + 1 : end;
+            line++;
+        }
+
+        for (; p < end && !failed; line++)
+        {
+            if (line < g->rows)
+            {
+                p = parse_line(p, text + size, target_row(g, line), g->cols);
+                failed = p == NULL;
+            }
+            else
+            {
+                // Only blank lines may follow the last row
+                while (p < text + size && is_blank(*p))
+                    p++;
+                failed = p < text + size && *p != '\n';
+                if (p < text + size)
+                    p++;
+            }
+        }
+    }
+
+    free(first_line);
+    return failed ? -1 : 0;
+}
+
+static int parse_stream(const text_target_t *g, const char *text, size_t size)
+{
+    const char *p = text, *end = text + size;
+    for (int i = 0; i < g->rows; i++)
+    {
+        int *row = target_row(g, i);
+        for (int j = 0; j < g->cols; j++)
+        {
+            while (p < end && (is_blank(*p) || *p == '\n'))
+                p++;
+            if (!(p = parse_int(p, end, &row[j])))
+                return -1;
+        }
+    }
+    return 0;
+}
+
+static int read_text_stdio(const text_target_t *g, FILE *input)
+{
+    for (int i = 0; i < g->rows; i++)
+    {
+        int *row = target_row(g, i);
+        for (int j = 0; j < g->cols; j++)
+            if (fscanf(input, "%d", &row[j]) != 1)
+                return -1;
+    }
+    return 0;
+}
+
+static int read_text(const text_target_t *g, FILE *input)
+{
+    // Map the rest of the file; streams that cannot be mapped go through stdio
+    struct stat st;
+    long offset = ftell(input);
+    if (offset < 0 || fstat(fileno(input), &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= offset)
+        return read_text_stdio(g, input);
+
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fileno(input), 0);
+    if (map == MAP_FAILED)
+        return read_text_stdio(g, input);
+    posix_madvise(map, (size_t)st.st_size, POSIX_MADV_SEQUENTIAL);
+
+    const char *text = (const char *)map + offset;
+    size_t size = (size_t)(st.st_size - offset);
+    int status = parse_lines(g, text, size);
+    if (status != 0)
+        status = parse_stream(g, text, size);
+
+    munmap(map, (size_t)st.st_size);
+    fseek(input, 0, SEEK_END);
+    return status;
+}
+
+int grid_read_text(grid_t *g, FILE *input)
+{
+#if CELL_BITS == 32
+    text_target_t target = {grid_row(g, 0), (size_t)g->stride, g->rows, g->cols};
+    return read_text(&target, input);
+#else
+    // Narrow cells are parsed into a wide copy first so that large piles survive
+    int *wide = malloc((size_t)g->rows * g->cols * sizeof(int));
+    if (!wide)
+        return -1;
+    text_target_t target = {wide, (size_t)g->cols, g->rows, g->cols};
+    int status = read_text(&target, input);
+    if (status == 0)
+        grid_narrow(g, wide);
+    free(wide);
+    return status;
+#endif
+}
+
+void grid_narrow(grid_t *g, int *wide)
+{
+    int rows = g->rows, cols = g->cols;
+
+    // In-place relaxation over the bounding box of the oversized cells, grown
+    // by one cell per pass; grains leaving the grid are dropped into the sink
+    int r0 = rows, r1 = -1, c0 = cols, c1 = -1;
+    for (int i = 0; i < rows; i++)
+        for (int j = 0; j < cols; j++)
+            if (wide[(size_t)i * cols + j] > CELL_SAFE)
+            {
+                r0 = i < r0 ? i : r0;
+                r1 = i > r1 ? i : r1;
+                c0 = j < c0 ? j : c0;
+                c1 = j > c1 ? j : c1;
+            }
+
+    while (r1 >= 0)
+    {
+        r0 = r0 > 0 ? r0 - 1 : 0;
+        r1 = r1 < rows - 1 ? r1 + 1 : rows - 1;
+        c0 = c0 > 0 ? c0 - 1 : 0;
+        c1 = c1 < cols - 1 ? c1 + 1 : cols - 1;
+
+        int big = 0;
+        for (int i = r0; i <= r1; i++)
+        {
+            int *row = wide + (size_t)i * cols;
+            for (int j = c0; j <= c1; j++)
+            {
+                int distribute = row[j] >> 2;
+                if (distribute == 0)
+                    continue;
+                row[j] &= 3;
+                if (i > 0)
+                    row[j - cols] += distribute;
+                if (i < rows - 1)
+                    row[j + cols] += distribute;
+                if (j > 0)
+                    row[j - 1] += distribute;
+                if (j < cols - 1)
+                    row[j + 1] += distribute;
+            }
+        }
+        for (int i = r0; i <= r1 && !big; i++)
+            for (int j = c0; j <= c1; j++)
+                if (wide[(size_t)i * cols + j] > CELL_SAFE)
+                    big = 1;
+        if (!big)
+            break;
+    }
+
+    for (int i = 0; i < rows; i++)
+    {
+        cell_t *row = grid_row(g, i);
+        for (int j = 0; j < cols; j++)
+            row[j] = (cell_t)wide[(size_t)i * cols + j];
+    }
+}
+
+// Appends v in decimal; returns the new end of the buffer.
+static char *format_int(char *p, int v)
+{
+    char digits[12];
+    int n = 0;
+    unsigned u = v < 0 ? 0u - (unsigned)v : (unsigned)v;
+    do
+        digits[n++] = (char)('0' + u % 10);
+    while (u /= 10);
+    if (v < 0)
+        *p++ = '-';
+    while (n)
+        *p++ = digits[--n];
+    return p;
+}
+
+void grid_write_text(const grid_t *g, FILE *output)
+{
+    // Rows are formatted into one buffer and written out in large blocks
+    size_t row_max = (size_t)g->cols * 12 + 1;
+    size_t capacity = row_max > TEXT_CHUNK_BYTES ? row_max : TEXT_CHUNK_BYTES;
+    char *buffer = malloc(capacity);
+    if (!buffer)
+    {
+        for (int i = 0; i < g->rows; i++)
+        {
+            const cell_t *row = grid_row(g, i);
+            for (int j = 0; j < g->cols; j++)
+                fprintf(output, "%d%s", row[j], j == g->cols - 1 ? "" : " ");
+            fprintf(output, "\n");
+        }
+        return;
+    }
+
+    char *p = buffer;
+    for (int i = 0; i < g->rows; i++)
+    {
+        if ((size_t)(p - buffer) + row_max > capacity)
+        {
+            fwrite(buffer, 1, (size_t)(p - buffer), output);
+            p = buffer;
+        }
+
+        const cell_t *row = grid_row(g, i);
+        for (int j = 0; j < g->cols; j++)
+        {
+            p = format_int(p, row[j]);
+            *p++ = ' ';
+        }
+        p[-1] = '\n';
+    }
+    fwrite(buffer, 1, (size_t)(p - buffer), output);
+    free(buffer);
+}
@@ -0,0 +1,94 @@
+/*
+ * Flat sandpile grid shared by the Serial, OpenMP and MPI drivers.
+ *
+ * The grid lives in one contiguous, cache-line aligned buffer surrounded by a
+ * one-cell border. The border models the sink: it is kept at zero (or simply
+ * ignored) so the topple loops never need `i > 0` / `j < M - 1` checks, and in
+ * the MPI driver the top and bottom border rows double as ghost rows.
+ *
+ * Cell (i, j) for 0 <= i < rows, 0 <= j < cols is GRID_AT(g, i, j); rows -1 and
+ * rows, and columns -1 and cols, address the border. Grids that need deeper
+ * ghost zones (see grid_alloc_halo) carry `halo` border rows above and below
+ * the interior, addressed as rows -halo .. -1 and rows .. rows + halo - 1.
+ */
+
+#ifndef SANDPILE_GRID_H
+#define SANDPILE_GRID_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define GRID_ALIGN 64
+
+// Cell storage width, chosen at compile time with -DCELL_BITS=8|16|32. A
+// Jacobi sweep turns cells of at most m into cells of at most 4 * (m >> 2) + 3,
+// so once every cell is at most CELL_SAFE a narrow type cannot overflow, and
+// the in-place engines, which can briefly double a cell, still fit. Larger
+// piles are toppled down in a wide pre-pass while loading (grid_narrow).
+#ifndef CELL_BITS
+#define CELL_BITS 32
+#endif
+
+#if CELL_BITS == 8
+typedef uint8_t cell_t;
+#define CELL_MAX UINT8_MAX
+#elif CELL_BITS == 16
+typedef uint16_t cell_t;
+#define CELL_MAX UINT16_MAX
+#elif CELL_BITS == 32
+typedef int cell_t;
+#define CELL_MAX INT32_MAX
+#else
+#error "CELL_BITS must be 8, 16 or 32"
+#endif
+
+#define CELL_SAFE (CELL_MAX / 4)
+
+typedef struct
+{
+    int rows;   // interior rows
+    int cols;   // interior columns
+    int halo;   // border rows above and below the interior (1 unless deeper)
+    int stride; // distance in cells between rows, border and padding included
+    cell_t *data; // (rows + 2 * halo) * stride cells, GRID_ALIGN aligned
+} grid_t;
+
+// Pointer to column 0 of row i (i may be negative or >= rows to reach the border).
+static inline cell_t *grid_row(const grid_t *g, int i)
+{
+    return g->data + (size_t)(i + g->halo) * g->stride + 1;
+}
+
+#define GRID_AT(g, i, j) (grid_row((g), (i))[(j)])
+
+// Row stride used for a grid with the given number of interior columns.
+int grid_stride(int cols);
+// Allocates a zeroed rows x cols grid. Returns 0 on success, -1 on failure.
+int grid_alloc(grid_t *g, int rows, int cols);
+// Same with `halo` border rows above and below instead of one.
+int grid_alloc_halo(grid_t *g, int rows, int cols, int halo);
+// Same, but the rows are zeroed by the OpenMP threads with a static schedule,
+// so on a NUMA machine each thread's share of rows sits on its own node for
+// loops that split the rows the same way. A plain allocation without OpenMP.
+int grid_alloc_first_touch(grid_t *g, int rows, int cols, int halo);
+void grid_free(grid_t *g);
+
+// Zeroes the whole buffer, border included.
+void grid_clear(grid_t *g);
+// Zeroes only the border cells.
+void grid_clear_border(grid_t *g);
+void grid_swap(grid_t *a, grid_t *b);
+
+// Reads rows * cols whitespace separated integers. Regular files are mapped
+// and parsed in place, split by line ranges across OpenMP threads when built
+// with OpenMP. Returns 0 on success.
+int grid_read_text(grid_t *g, FILE *input);
+// Stores a rows x cols row-major array of wide values into g. Piles above
+// CELL_SAFE are first relaxed in place on the wide array, which is modified.
+void grid_narrow(grid_t *g, int *wide);
+
+// Writes the interior, one row per line, values separated by single spaces.
+void grid_write_text(const grid_t *g, FILE *output);
+
+#endif
@@ -0,0 +1,191 @@
+#include "grid_bin.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static void put_u32(unsigned char *p, uint32_t v)
+{
+    for (int k = 0; k < 4; k++)
+        p[k] = (unsigned char)(v >> (8 * k));
+}
+
+static uint32_t get_u32(const unsigned char *p)
+{
+    uint32_t v = 0;
+    for (int k = 0; k < 4; k++)
+        v |= (uint32_t)p[k] << (8 * k);
+    return v;
+}
+
+void grid_bin_encode_header(const grid_bin_header_t *h, unsigned char out[GRID_BIN_HEADER_BYTES])
+{
+    memcpy(out, GRID_BIN_MAGIC, 4);
+    put_u32(out + 4, (uint32_t)h->rows);
+    put_u32(out + 8, (uint32_t)h->cols);
+    put_u32(out + 12, (uint32_t)h->cell_bytes);
+    put_u32(out + 16, (uint32_t)h->iteration);
+    put_u32(out + 20, (uint32_t)(h->iteration >> 32));
+}
+
+int grid_bin_decode_header(const unsigned char buf[GRID_BIN_HEADER_BYTES], grid_bin_header_t *h)
+{
+    if (memcmp(buf, GRID_BIN_MAGIC, 4) != 0)
+        return -1;
+    h->rows = (int)get_u32(buf + 4);
+    h->cols = (int)get_u32(buf + 8);
+    h->cell_bytes = (int)get_u32(buf + 12);
+    h->iteration = get_u32(buf + 16) | (uint64_t)get_u32(buf + 20) << 32;
+    if (h->rows <= 0 || h->cols <= 0 || (h->cell_bytes != 1 && h->cell_bytes != 2 && h->cell_bytes != 4))
+        return -1;
+    return 0;
+}
+
+int grid_bin_detect(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return 0;
+    char magic[4];
+    int binary = fread(magic, 1, 4, f) == 4 && memcmp(magic, GRID_BIN_MAGIC, 4) == 0;
+    fclose(f);
+    return binary;
+}
+
+int grid_bin_read_header(FILE *input, grid_bin_header_t *h)
+{
+    unsigned char buf[GRID_BIN_HEADER_BYTES];
+    if (fread(buf, 1, sizeof buf, input) != sizeof buf)
+        return -1;
+    return grid_bin_decode_header(buf, h);
+}
+
+static uint32_t packed_at(const void *packed, int cell_bytes, size_t k)
+{
+    if (cell_bytes == 1)
+        return ((const uint8_t *)packed)[k];
+    if (cell_bytes == 2)
+        return ((const uint16_t *)packed)[k];
+    return ((const uint32_t *)packed)[k];
+}
+
+void grid_bin_unpack(const void *packed, int cell_bytes, cell_t *cells, int n)
+{
+    if (cell_bytes == (int)sizeof(cell_t))
+        memcpy(cells, packed, (size_t)n * sizeof(cell_t));
+    else
+        for (int j = 0; j < n; j++)
+            cells[j] = (cell_t)packed_at(packed, cell_bytes, j);
+}
+
+void grid_bin_pack(const cell_t *cells, int cell_bytes, void *packed, int n)
+{
+    if (cell_bytes == (int)sizeof(cell_t))
+        memcpy(packed, cells, (size_t)n * sizeof(cell_t));
+    else if (cell_bytes == 1)
+        for (int j = 0; j < n; j++)
+            ((uint8_t *)packed)[j] = (uint8_t)cells[j];
+    else if (cell_bytes == 2)
+        for (int j = 0; j < n; j++)
+            ((uint16_t *)packed)[j] = (uint16_t)cells[j];
+    else
+        for (int j = 0; j < n; j++)
+            ((uint32_t *)packed)[j] = (uint32_t)cells[j];
+}
+
+uint32_t grid_bin_max(const void *packed, int cell_bytes, size_t n)
+{
+    uint32_t top = 0;
+    for (size_t k = 0; k < n; k++)
+    {
+        uint32_t v = packed_at(packed, cell_bytes, k);
+        top = v > top ? v : top;
+    }
+    return top;
+}
+
+int grid_bin_read_wide(grid_t *g, FILE *input, const grid_bin_header_t *h)
+{
+    size_t n = (size_t)g->rows * g->cols;
+    void *packed = malloc(n * h->cell_bytes);
+    int *wide = malloc(n * sizeof(int));
+    int status = packed && wide && fread(packed, h->cell_bytes, n, input) == n ? 0 : -1;
+    if (status == 0)
+    {
+        for (size_t k = 0; k < n; k++)
+            wide[k] = (int)packed_at(packed, h->cell_bytes, k);
+        grid_narrow(g, wide);
+    }
+    free(packed);
+    free(wide);
+    return status;
+}
+
+// Runs grid_narrow over a grid already read at its own width if any cell is
+// above CELL_SAFE
+static int narrow_in_place(grid_t *g)
+{
+    int big = 0;
+    for (int i = 0; i < g->rows && !big; i++)
+        big = grid_bin_max(grid_row(g, i), (int)sizeof(cell_t), (size_t)g->cols) > CELL_SAFE;
+    if (!big)
+        return 0;
+
+    int *wide = malloc((size_t)g->rows * g->cols * sizeof(int));
+    if (!wide)
+        return -1;
+    for (int i = 0; i < g->rows; i++)
+        for (int j = 0; j < g->cols; j++)
+            wide[(size_t)i * g->cols + j] = GRID_AT(g, i, j);
+    grid_narrow(g, wide);
+    free(wide);
+    return 0;
+}
+
+int grid_bin_read_cells(grid_t *g, FILE *input, const grid_bin_header_t *h)
+{
+    if (h->rows != g->rows || h->cols != g->cols)
+        return -1;
+    if (h->cell_bytes > (int)sizeof(cell_t))
+        return grid_bin_read_wide(g, input, h);
+
+    // Rows of the grid's own width land in place; others go through a row buffer
+    void *packed = h->cell_bytes == (int)sizeof(cell_t) ? NULL : malloc((size_t)g->cols * h->cell_bytes);
+    int status = 0;
+    for (int i = 0; i < g->rows && status == 0; i++)
+    {
+        cell_t *row = grid_row(g, i);
+        void *dst = packed ? packed : (void *)row;
+        if (fread(dst, h->cell_bytes, g->cols, input) != (size_t)g->cols)
+            status = -1;
+        else if (packed)
+            grid_bin_unpack(packed, h->cell_bytes, row, g->cols);
+    }
+    free(packed);
+
+    // A file of the grid's own width can still hold piles above CELL_SAFE,
+    // which the in-place engines could overflow; they are toppled down with
+    // the same wide pre-pass as wider files
+    if (status == 0 && CELL_BITS < 32 && h->cell_bytes == (int)sizeof(cell_t))
+        status = narrow_in_place(g);
+    return status;
+}
+
+int grid_bin_write(const grid_t *g, FILE *output, int cell_bytes, uint64_t iteration)
+{
+    grid_bin_header_t h = {g->rows, g->cols, cell_bytes, iteration};
+    unsigned char buf[GRID_BIN_HEADER_BYTES];
+    grid_bin_encode_header(&h, buf);
+    if (fwrite(buf, 1, sizeof buf, output) != sizeof buf)
+        return -1;
+
+    void *packed = malloc((size_t)g->cols * cell_bytes);
+    int status = 0;
+    for (int i = 0; i < g->rows && status == 0; i++)
+    {
+        grid_bin_pack(grid_row(g, i), cell_bytes, packed, g->cols);
+        if (fwrite(packed, cell_bytes, g->cols, output) != (size_t)g->cols)
+            status = -1;
+    }
+    free(packed);
+    return status;
+}
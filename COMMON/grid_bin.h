@@ -0,0 +1,59 @@
+/*
+ * Compact binary grid format (.spg).
+ *
+ *   offset  size  field
+ *        0     4  magic "SPG1"
+ *        4     4  rows           (uint32)
+ *        8     4  cols           (uint32)
+ *       12     4  cell width     (uint32: 1, 2 or 4 bytes)
+ *       16     8  iteration      (uint64: sweeps already applied, 0 for inputs)
+ *       24     -  rows * cols cells, row-major, unsigned, little-endian
+ *
+ * Stable grids only hold 0..3 and are written with 1-byte cells. The fixed
+ * header size lets every MPI rank compute its own slab's offset and read or
+ * write it directly with MPI-IO. grid_convert.py converts to and from the
+ * text format of input_grids/.
+ */
+
+#ifndef SANDPILE_GRID_BIN_H
+#define SANDPILE_GRID_BIN_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "grid.h"
+
+#define GRID_BIN_MAGIC "SPG1"
+#define GRID_BIN_HEADER_BYTES 24
+
+typedef struct
+{
+    int rows, cols;
+    int cell_bytes;
+    uint64_t iteration;
+} grid_bin_header_t;
+
+void grid_bin_encode_header(const grid_bin_header_t *h, unsigned char out[GRID_BIN_HEADER_BYTES]);
+// Returns 0 if buf holds a valid header, -1 otherwise.
+int grid_bin_decode_header(const unsigned char buf[GRID_BIN_HEADER_BYTES], grid_bin_header_t *h);
+
+// Returns 1 if the file at path starts with the binary magic, 0 otherwise.
+int grid_bin_detect(const char *path);
+// Reads the header at the current position. Returns 0 on success and -1 if
+// the file is not in the binary format (the position is then unspecified).
+int grid_bin_read_header(FILE *input, grid_bin_header_t *h);
+// Reads the cells that follow a header into g, which must match its size.
+int grid_bin_read_cells(grid_t *g, FILE *input, const grid_bin_header_t *h);
+// Writes header and cells with the given cell width. Returns 0 on success.
+int grid_bin_write(const grid_t *g, FILE *output, int cell_bytes, uint64_t iteration);
+
+// Converts n packed cells of the given width to and from grid cells. Unpacking
+// a width wider than cell_t requires every value to fit (see grid_bin_max).
+void grid_bin_unpack(const void *packed, int cell_bytes, cell_t *cells, int n);
+void grid_bin_pack(const cell_t *cells, int cell_bytes, void *packed, int n);
+// Largest of n packed cells.
+uint32_t grid_bin_max(const void *packed, int cell_bytes, size_t n);
+// Reads rows * cols packed cells into a wide row-major array and hands it to
+// grid_narrow; used when the file's cells are wider than cell_t.
+int grid_bin_read_wide(grid_t *g, FILE *input, const grid_bin_header_t *h);
+
+#endif
@@ -0,0 +1,152 @@
+// mkdir under -std=c11
+#define _POSIX_C_SOURCE 200809L
+
+#include "group.h"
+#include "grid_bin.h"
+#include "kernel.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+int group_add(grid_t *a, const grid_t *b)
+{
+    if (a->rows != b->rows || a->cols != b->cols)
+        return -1;
+    for (int i = 0; i < a->rows; i++)
+    {
+        cell_t *row = grid_row(a, i);
+        const cell_t *add = grid_row(b, i);
+        for (int j = 0; j < a->cols; j++)
+        {
+            if ((long)row[j] + add[j] > CELL_SAFE)
+                return -1;
+            row[j] = (cell_t)(row[j] + add[j]);
+        }
+    }
+    return 0;
+}
+
+long group_stabilize(grid_t *g, long *sweeps)
+{
+    grid_t next;
+    if (grid_alloc(&next, g->rows, g->cols) != 0)
+        return -1;
+    sandpile_kernel_init();
+
+    // Same Jacobi loop as the serial driver; an odd number of sweeps leaves
+    // the result in the scratch buffer, which then takes g's place
+    grid_t cur = *g;
+    long topples = 0, count = 0, pass;
+    do
+    {
+        pass = sandpile_sweep(&cur, &next, 0, cur.rows, 0, cur.cols, NULL);
+        topples += pass;
+        grid_swap(&cur, &next);
+        count++;
+    } while (pass > 0);
+
+    *g = cur;
+    grid_free(&next);
+    if (sweeps)
+        *sweeps = count;
+    return topples;
+}
+
+static char *cache_path(const char *cache_dir, const grid_t *e, const char *suffix)
+{
+    char *path = malloc(strlen(cache_dir) + 64);
+    if (path)
+        sprintf(path, "%s/identity_%dx%d_%s.spg%s", cache_dir, e->rows, e->cols, GROUP_BOUNDARY, suffix);
+    return path;
+}
+
+static int cache_load(const char *cache_dir, grid_t *e)
+{
+    char *path = cache_path(cache_dir, e, "");
+    FILE *input = path ? fopen(path, "rb") : NULL;
+    grid_bin_header_t header;
+    int status = -1;
+    if (input && grid_bin_read_header(input, &header) == 0 && header.rows == e->rows && header.cols == e->cols)
+        status = grid_bin_read_cells(e, input, &header);
+    if (input)
+        fclose(input);
+    free(path);
+    return status;
+}
+
+// Written under a temporary name and renamed, so concurrent jobs never see
+// half a file
+static void cache_store(const char *cache_dir, const grid_t *e)
+{
+    if (mkdir(cache_dir, 0777) != 0 && errno != EEXIST)
+        return;
+    char *path = cache_path(cache_dir, e, "");
+    char *tmp = cache_path(cache_dir, e, ".tmp");
+    FILE *output = tmp ? fopen(tmp, "wb") : NULL;
+    if (output)
+    {
+        int status = grid_bin_write(e, output, 1, 0);
+        if (fclose(output) == 0 && status == 0)
+            rename(tmp, path);
+        else
+            remove(tmp);
+    }
+    free(path);
+    free(tmp);
+}
+
+int group_identity(grid_t *e, const char *cache_dir)
+{
+    if (cache_dir && cache_load(cache_dir, e) == 0)
+        return 0;
+
+    for (int i = 0; i < e->rows; i++)
+    {
+        cell_t *row = grid_row(e, i);
+        for (int j = 0; j < e->cols; j++)
+            row[j] = 6;
+    }
+    if (group_stabilize(e, NULL) < 0)
+        return -1;
+    for (int i = 0; i < e->rows; i++)
+    {
+        cell_t *row = grid_row(e, i);
+        for (int j = 0; j < e->cols; j++)
+            row[j] = (cell_t)(6 - row[j]);
+    }
+    if (group_stabilize(e, NULL) < 0)
+        return -1;
+
+    if (cache_dir)
+        cache_store(cache_dir, e);
+    return 0;
+}
+
+int group_is_recurrent(const grid_t *g)
+{
+    grid_t burn;
+    if (grid_alloc(&burn, g->rows, g->cols) != 0)
+        return -1;
+
+    // One grain for every edge that leads into the sink
+    for (int i = 0; i < g->rows; i++)
+    {
+        const cell_t *row = grid_row(g, i);
+        cell_t *out = grid_row(&burn, i);
+        for (int j = 0; j < g->cols; j++)
+            out[j] = (cell_t)(row[j] + (i == 0) + (i == g->rows - 1) + (j == 0) + (j == g->cols - 1));
+    }
+
+    int recurrent = -1;
+    if (group_stabilize(&burn, NULL) >= 0)
+    {
+        recurrent = 1;
+        for (int i = 0; i < g->rows && recurrent; i++)
+            if (memcmp(grid_row(&burn, i), grid_row(g, i), (size_t)g->cols * sizeof(cell_t)) != 0)
+                recurrent = 0;
+    }
+    grid_free(&burn);
+    return recurrent;
+}
@@ -0,0 +1,44 @@
+/*
+ * Sandpile group operations on grids with a sink boundary.
+ *
+ * The stable configurations that are reachable from every other one (the
+ * recurrent configurations) form an abelian group under "add cellwise, then
+ * stabilize". Its identity depends only on the grid size and the boundary and
+ * is expensive to compute, so group_identity keeps the ones it has computed
+ * in a cache directory as binary grids (grid_bin.h), one file per size and
+ * boundary. All functions work on ordinary bordered grids and call the same
+ * Jacobi kernel as the drivers.
+ */
+
+#ifndef SANDPILE_GROUP_H
+#define SANDPILE_GROUP_H
+
+#include <stdbool.h>
+#include "grid.h"
+
+// Name of the boundary in cache keys; every edge of the grid drains into the sink
+#define GROUP_BOUNDARY "sink"
+
+// Adds b to a cell by cell without stabilizing. Returns -1, leaving a partly
+// updated, if the sizes differ or a sum exceeds CELL_SAFE (the kernel could
+// overflow it); 0 otherwise.
+int group_add(grid_t *a, const grid_t *b);
+
+// Stabilizes g in place. Returns the number of topples and stores the number
+// of sweeps in *sweeps unless it is NULL; -1 if the scratch grid could not be
+// allocated.
+long group_stabilize(grid_t *g, long *sweeps);
+
+// Fills e, allocated with the wanted size, with the identity of the sandpile
+// group, (6 - (6)°)° where 6 is the all-sixes grid and ° stabilization. With a
+// cache_dir the identity is read from there if present and stored after it
+// has been computed; cache failures only cost the recomputation. Returns 0 on
+// success, -1 if it could not be computed.
+int group_identity(grid_t *e, const char *cache_dir);
+
+// Burning test: g, which must be stable, is recurrent exactly if adding one
+// grain per sink edge of every cell and stabilizing gives back g. Returns 1 or
+// 0, or -1 if memory ran out.
+int group_is_recurrent(const grid_t *g);
+
+#endif
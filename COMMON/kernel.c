@@ -0,0 +1,357 @@
+#include "kernel.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SANDPILE_X86 1
+#endif
+
+static long sweep_row_scalar(const cell_t *up, const cell_t *mid, const cell_t *down, cell_t *out, int n,
+                             int *unstable)
+{
+    long topples = 0;
+    int spill = 0;
+    for (int j = 0; j < n; j++)
+    {
+        int g = mid[j];
+        int v = (g & 3) + (up[j] >> 2) + (down[j] >> 2) + (mid[j - 1] >> 2) + (mid[j + 1] >> 2);
+        out[j] = (cell_t)v;
+        topples += g >> 2;
+        spill |= v >> 2;
+    }
+    if (unstable && spill)
+        *unstable = 1;
+    return topples;
+}
+
+#ifdef SANDPILE_X86
+
+// Each SIMD kernel has one body per cell width. Sums never need to widen: a
+// sweep of cells that fit keeps them fitting (see grid.h). Only the topple
+// count is accumulated in wider lanes.
+
+#if CELL_BITS == 8
+
+// There is no 8-bit shift; shift 16-bit lanes and drop the bits that crossed over
+#define SHR2_AVX2(x) _mm256_and_si256(_mm256_srli_epi16((x), 2), _mm256_set1_epi8(0x3F))
+#define SHR2_AVX512(x) _mm512_and_si512(_mm512_srli_epi16((x), 2), _mm512_set1_epi8(0x3F))
+
+__attribute__((target("avx2"))) static long sweep_row_avx2(const cell_t *up, const cell_t *mid, const cell_t *down,
+                                                          cell_t *out, int n, int *unstable)
+{
+    const __m256i low = _mm256_set1_epi8(3);
+    const __m256i high = _mm256_set1_epi8((char)0xFC);
+    __m256i acc = _mm256_setzero_si256();
+    __m256i over = _mm256_setzero_si256();
+    int j = 0;
+    for (; j + 32 <= n; j += 32)
+    {
+        __m256i g = _mm256_loadu_si256((const __m256i *)(mid + j));
+        __m256i l = _mm256_loadu_si256((const __m256i *)(mid + j - 1));
+        __m256i r = _mm256_loadu_si256((const __m256i *)(mid + j + 1));
+        __m256i u = _mm256_loadu_si256((const __m256i *)(up + j));
+        __m256i d = _mm256_loadu_si256((const __m256i *)(down + j));
+
+        __m256i spill = SHR2_AVX2(g);
+        __m256i sum = _mm256_add_epi8(SHR2_AVX2(u), SHR2_AVX2(d));
+        sum = _mm256_add_epi8(sum, _mm256_add_epi8(SHR2_AVX2(l), SHR2_AVX2(r)));
+        sum = _mm256_add_epi8(sum, _mm256_and_si256(g, low));
+        _mm256_storeu_si256((__m256i *)(out + j), sum);
+        // Byte sums against zero add the spills up in four 64-bit lanes
+        acc = _mm256_add_epi64(acc, _mm256_sad_epu8(spill, _mm256_setzero_si256()));
+        over = _mm256_or_si256(over, _mm256_and_si256(sum, high));
+    }
+
+    if (unstable && !_mm256_testz_si256(over, over))
+        *unstable = 1;
+
+    long long lanes[4];
+    _mm256_storeu_si256((__m256i *)lanes, acc);
+    long topples = (long)(lanes[0] + lanes[1] + lanes[2] + lanes[3]);
+    return topples + sweep_row_scalar(up + j, mid + j, down + j, out + j, n - j, unstable);
+}
+
+__attribute__((target("avx512f,avx512bw"))) static long sweep_row_avx512(const cell_t *up, const cell_t *mid,
+                                                                        const cell_t *down, cell_t *out, int n,
+                                                                        int *unstable)
+{
+    const __m512i low = _mm512_set1_epi8(3);
+    const __m512i high = _mm512_set1_epi8((char)0xFC);
+    __m512i acc = _mm512_setzero_si512();
+    __mmask64 over = 0;
+    for (int j = 0; j < n; j += 64)
+    {
+        __mmask64 m = n - j >= 64 ? ~(__mmask64)0 : (((__mmask64)1 << (n - j)) - 1);
+        __m512i g = _mm512_maskz_loadu_epi8(m, mid + j);
+        __m512i l = _mm512_maskz_loadu_epi8(m, mid + j - 1);
+        __m512i r = _mm512_maskz_loadu_epi8(m, mid + j + 1);
+        __m512i u = _mm512_maskz_loadu_epi8(m, up + j);
+        __m512i d = _mm512_maskz_loadu_epi8(m, down + j);
+
+        __m512i spill = SHR2_AVX512(g);
+        __m512i sum = _mm512_add_epi8(SHR2_AVX512(u), SHR2_AVX512(d));
+        sum = _mm512_add_epi8(sum, _mm512_add_epi8(SHR2_AVX512(l), SHR2_AVX512(r)));
+        sum = _mm512_add_epi8(sum, _mm512_and_si512(g, low));
+        _mm512_mask_storeu_epi8(out + j, m, sum);
+        acc = _mm512_add_epi64(acc, _mm512_sad_epu8(spill, _mm512_setzero_si512()));
+        over |= _mm512_mask_test_epi8_mask(m, sum, high);
+    }
+    if (unstable && over)
+        *unstable = 1;
+    return (long)_mm512_reduce_add_epi64(acc);
+}
+
+#elif CELL_BITS == 16
+
+__attribute__((target("avx2"))) static long sweep_row_avx2(const cell_t *up, const cell_t *mid, const cell_t *down,
+                                                          cell_t *out, int n, int *unstable)
+{
+    const __m256i low = _mm256_set1_epi16(3);
+    const __m256i ones = _mm256_set1_epi16(1);
+    __m256i acc = _mm256_setzero_si256();
+    __m256i over = _mm256_setzero_si256();
+    int j = 0;
+    for (; j + 16 <= n; j += 16)
+    {
+        __m256i g = _mm256_loadu_si256((const __m256i *)(mid + j));
+        __m256i l = _mm256_loadu_si256((const __m256i *)(mid + j - 1));
+        __m256i r = _mm256_loadu_si256((const __m256i *)(mid + j + 1));
+        __m256i u = _mm256_loadu_si256((const __m256i *)(up + j));
+        __m256i d = _mm256_loadu_si256((const __m256i *)(down + j));
+
+        __m256i spill = _mm256_srli_epi16(g, 2);
+        __m256i sum = _mm256_add_epi16(_mm256_srli_epi16(u, 2), _mm256_srli_epi16(d, 2));
+        sum = _mm256_add_epi16(sum, _mm256_add_epi16(_mm256_srli_epi16(l, 2), _mm256_srli_epi16(r, 2)));
+        sum = _mm256_add_epi16(sum, _mm256_and_si256(g, low));
+        _mm256_storeu_si256((__m256i *)(out + j), sum);
+        // Spills are below 2^14, so pairwise multiply-adds cannot overflow
+        acc = _mm256_add_epi32(acc, _mm256_madd_epi16(spill, ones));
+        over = _mm256_or_si256(over, _mm256_srli_epi16(sum, 2));
+    }
+
+    if (unstable && !_mm256_testz_si256(over, over))
+        *unstable = 1;
+
+    int lanes[8];
+    _mm256_storeu_si256((__m256i *)lanes, acc);
+    long topples = 0;
+    for (int k = 0; k < 8; k++)
+        topples += lanes[k];
+    return topples + sweep_row_scalar(up + j, mid + j, down + j, out + j, n - j, unstable);
+}
+
+__attribute__((target("avx512f,avx512bw"))) static long sweep_row_avx512(const cell_t *up, const cell_t *mid,
+                                                                        const cell_t *down, cell_t *out, int n,
+                                                                        int *unstable)
+{
+    const __m512i low = _mm512_set1_epi16(3);
+    const __m512i ones = _mm512_set1_epi16(1);
+    __m512i acc = _mm512_setzero_si512();
+    __m512i over = _mm512_setzero_si512();
+    for (int j = 0; j < n; j += 32)
+    {
+        __mmask32 m = n - j >= 32 ? ~(__mmask32)0 : (__mmask32)((1u << (n - j)) - 1);
+        __m512i g = _mm512_maskz_loadu_epi16(m, mid + j);
+        __m512i l = _mm512_maskz_loadu_epi16(m, mid + j - 1);
+        __m512i r = _mm512_maskz_loadu_epi16(m, mid + j + 1);
+        __m512i u = _mm512_maskz_loadu_epi16(m, up + j);
+        __m512i d = _mm512_maskz_loadu_epi16(m, down + j);
+
+        __m512i spill = _mm512_srli_epi16(g, 2);
+        __m512i sum = _mm512_add_epi16(_mm512_srli_epi16(u, 2), _mm512_srli_epi16(d, 2));
+        sum = _mm512_add_epi16(sum, _mm512_add_epi16(_mm512_srli_epi16(l, 2), _mm512_srli_epi16(r, 2)));
+        sum = _mm512_add_epi16(sum, _mm512_and_si512(g, low));
+        _mm512_mask_storeu_epi16(out + j, m, sum);
+        acc = _mm512_add_epi32(acc, _mm512_madd_epi16(spill, ones));
+        over = _mm512_or_si512(over, _mm512_maskz_srli_epi16(m, sum, 2));
+    }
+    if (unstable && _mm512_test_epi16_mask(over, over))
+        *unstable = 1;
+    return _mm512_reduce_add_epi32(acc);
+}
+
+#else
+
+__attribute__((target("avx2"))) static long sweep_row_avx2(const cell_t *up, const cell_t *mid, const cell_t *down,
+                                                          cell_t *out, int n, int *unstable)
+{
+    const __m256i low = _mm256_set1_epi32(3);
+    __m256i acc = _mm256_setzero_si256();
+    __m256i over = _mm256_setzero_si256();
+    int j = 0;
+    for (; j + 8 <= n; j += 8)
+    {
+        __m256i g = _mm256_loadu_si256((const __m256i *)(mid + j));
+        __m256i l = _mm256_loadu_si256((const __m256i *)(mid + j - 1));
+        __m256i r = _mm256_loadu_si256((const __m256i *)(mid + j + 1));
+        __m256i u = _mm256_loadu_si256((const __m256i *)(up + j));
+        __m256i d = _mm256_loadu_si256((const __m256i *)(down + j));
+
+        __m256i spill = _mm256_srli_epi32(g, 2);
+        __m256i sum = _mm256_add_epi32(_mm256_srli_epi32(u, 2), _mm256_srli_epi32(d, 2));
+        sum = _mm256_add_epi32(sum, _mm256_add_epi32(_mm256_srli_epi32(l, 2), _mm256_srli_epi32(r, 2)));
+        sum = _mm256_add_epi32(sum, _mm256_and_si256(g, low));
+        _mm256_storeu_si256((__m256i *)(out + j), sum);
+        acc = _mm256_add_epi32(acc, spill);
+        over = _mm256_or_si256(over, _mm256_srli_epi32(sum, 2));
+    }
+
+    if (unstable && !_mm256_testz_si256(over, over))
+        *unstable = 1;
+
+    int lanes[8];
+    _mm256_storeu_si256((__m256i *)lanes, acc);
+    long topples = 0;
+    for (int k = 0; k < 8; k++)
+        topples += lanes[k];
+    return topples + sweep_row_scalar(up + j, mid + j, down + j, out + j, n - j, unstable);
+}
+
+__attribute__((target("avx512f"))) static long sweep_row_avx512(const cell_t *up, const cell_t *mid,
+                                                               const cell_t *down, cell_t *out, int n,
+                                                               int *unstable)
+{
+    const __m512i low = _mm512_set1_epi32(3);
+    __m512i acc = _mm512_setzero_si512();
+    __m512i over = _mm512_setzero_si512();
+    for (int j = 0; j < n; j += 16)
+    {
+        // The tail is handled with a lane mask instead of a scalar loop
+        __mmask16 m = n - j >= 16 ? (__mmask16)0xFFFF : (__mmask16)((1u << (n - j)) - 1);
+        __m512i g = _mm512_maskz_loadu_epi32(m, mid + j);
+        __m512i l = _mm512_maskz_loadu_epi32(m, mid + j - 1);
+        __m512i r = _mm512_maskz_loadu_epi32(m, mid + j + 1);
+        __m512i u = _mm512_maskz_loadu_epi32(m, up + j);
+        __m512i d = _mm512_maskz_loadu_epi32(m, down + j);
+
+        __m512i spill = _mm512_srli_epi32(g, 2);
+        __m512i sum = _mm512_add_epi32(_mm512_srli_epi32(u, 2), _mm512_srli_epi32(d, 2));
+        sum = _mm512_add_epi32(sum, _mm512_add_epi32(_mm512_srli_epi32(l, 2), _mm512_srli_epi32(r, 2)));
+        sum = _mm512_add_epi32(sum, _mm512_and_si512(g, low));
+        _mm512_mask_storeu_epi32(out + j, m, sum);
+        acc = _mm512_add_epi32(acc, spill);
+        over = _mm512_or_si512(over, _mm512_maskz_srli_epi32(m, sum, 2));
+    }
+    if (unstable && _mm512_test_epi32_mask(over, over))
+        *unstable = 1;
+    return _mm512_reduce_add_epi32(acc);
+}
+
+#endif
+
+#endif
+
+static int detected = -1;
+static sweep_row_fn selected;
+static const char *selected_name;
+
+int sandpile_kernel_isa(void)
+{
+    if (detected >= 0)
+        return detected;
+
+    const char *want = getenv("SANDPILE_KERNEL");
+    int isa = KERNEL_ISA_SCALAR;
+
+#ifdef SANDPILE_X86
+    __builtin_cpu_init();
+    // The 8- and 16-bit kernels need the AVX-512 byte and word instructions
+    int has_avx512 = __builtin_cpu_supports("avx512f") && (CELL_BITS == 32 || __builtin_cpu_supports("avx512bw"));
+    int has_avx2 = __builtin_cpu_supports("avx2");
+    if (want && strcmp(want, "scalar") == 0)
+        has_avx512 = has_avx2 = 0;
+    else if (want && strcmp(want, "avx2") == 0)
+        has_avx512 = 0;
+
+    if (has_avx512)
+        isa = KERNEL_ISA_AVX512;
+    else if (has_avx2)
+        isa = KERNEL_ISA_AVX2;
+#else
+    (void)want;
+#endif
+
+    detected = isa;
+    return detected;
+}
+
+void sandpile_kernel_init(void)
+{
+    if (selected)
+        return;
+
+    sweep_row_fn fn = sweep_row_scalar;
+    const char *name = "scalar";
+#ifdef SANDPILE_X86
+    switch (sandpile_kernel_isa())
+    {
+    case KERNEL_ISA_AVX512:
+        fn = sweep_row_avx512;
+        name = "avx512";
+        break;
+    case KERNEL_ISA_AVX2:
+        fn = sweep_row_avx2;
+        name = "avx2";
+        break;
+    }
+#endif
+
+    selected_name = name;
+    selected = fn;
+}
+
+const char *sandpile_kernel_name(void)
+{
+    sandpile_kernel_init();
+    return selected_name;
+}
+
+long sandpile_sweep_row(const cell_t *up, const cell_t *mid, const cell_t *down, cell_t *out, int n,
+                        int *unstable)
+{
+    sandpile_kernel_init();
+    return selected(up, mid, down, out, n, unstable);
+}
+
+long sandpile_sweep(const grid_t *cur, grid_t *next, int row_begin, int row_end,
+                    int col_begin, int col_end, int *unstable)
+{
+    sandpile_kernel_init();
+    sweep_row_fn fn = selected;
+    int n = col_end - col_begin;
+    long topples = 0;
+    for (int i = row_begin; i < row_end; i++)
+    {
+        const cell_t *mid = grid_row(cur, i) + col_begin;
+        topples += fn(mid - cur->stride, mid, mid + cur->stride, grid_row(next, i) + col_begin, n,
+                      unstable);
+    }
+    return topples;
+}
+
+long sandpile_relax(grid_t *g, int row_begin, int row_end, int col_begin, int col_end)
+{
+    long topples = 0;
+    int stride = g->stride;
+    for (int i = row_begin; i < row_end; i++)
+    {
+        cell_t *row = grid_row(g, i);
+        for (int j = col_begin; j < col_end; j++)
+        {
+            int grains = row[j];
+            if (grains >= 4)
+            {
+                int distribute = grains >> 2;
+                row[j] = grains & 3;
+                row[j - 1] += distribute;
+                row[j + 1] += distribute;
+                row[j - stride] += distribute;
+                row[j + stride] += distribute;
+                topples += distribute;
+            }
+        }
+    }
+    return topples;
+}
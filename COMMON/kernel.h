@@ -0,0 +1,63 @@
+/*
+ * Branch-free Jacobi topple kernel.
+ *
+ * One sweep is written as a gather stencil over the bordered grid:
+ *
+ *     next = (g & 3) + (up >> 2) + (down >> 2) + (left >> 2) + (right >> 2)
+ *
+ * which is exactly the scatter form `keep = g % 4`, `distribute = g / 4` for
+ * non-negative cells. Row kernels exist for AVX-512, AVX2 and plain C, each
+ * built for the compile-time cell width (64, 32 or 16 cells per AVX-512 op for
+ * 8-, 16- and 32-bit cells); the widest one the CPU supports is picked at
+ * run time. Setting SANDPILE_KERNEL=scalar|avx2|avx512 overrides the choice.
+ */
+
+#ifndef SANDPILE_KERNEL_H
+#define SANDPILE_KERNEL_H
+
+#include "grid.h"
+
+// Computes n cells of one output row from the three input rows around it and
+// returns the number of topples, i.e. the sum of mid[j] >> 2. mid[-1] and
+// mid[n] are read as the left and right neighbours. If unstable is not NULL it
+// is set to 1 when any output cell is 4 or more (it is never cleared).
+typedef long (*sweep_row_fn)(const cell_t *up, const cell_t *mid, const cell_t *down, cell_t *out, int n,
+                             int *unstable);
+
+// Instruction sets a kernel can be built for
+enum
+{
+    KERNEL_ISA_SCALAR,
+    KERNEL_ISA_AVX2,
+    KERNEL_ISA_AVX512
+};
+
+// Widest instruction set the CPU supports for the compile-time cell width,
+// lowered by SANDPILE_KERNEL. Every vectorized kernel dispatches on it, so the
+// override means the same everywhere; same threading rule as below.
+int sandpile_kernel_isa(void);
+
+// Selects the row kernel. Safe to call more than once; call it before entering
+// parallel regions so threads never race on the first selection.
+void sandpile_kernel_init(void);
+// Name of the selected row kernel ("avx512", "avx2" or "scalar").
+const char *sandpile_kernel_name(void);
+
+long sandpile_sweep_row(const cell_t *up, const cell_t *mid, const cell_t *down, cell_t *out, int n,
+                        int *unstable);
+
+// Sweeps rows [row_begin, row_end) and columns [col_begin, col_end) of cur
+// into next and returns the number of topples. Cells outside the rectangle
+// are read but never written, so the border of next stays zero. unstable is
+// handled as for the row kernel.
+long sandpile_sweep(const grid_t *cur, grid_t *next, int row_begin, int row_end,
+                    int col_begin, int col_end, int *unstable);
+
+// One in-place (Gauss-Seidel) pass over rows [row_begin, row_end) and columns
+// [col_begin, col_end): every cell holding 4 or more grains topples fully and
+// its neighbours see the grains immediately. Grains pushed outside the
+// rectangle land in the neighbouring cells, so a pass over a whole grid
+// leaves the sink grains in its border. Returns the number of topples.
+long sandpile_relax(grid_t *g, int row_begin, int row_end, int col_begin, int col_end);
+
+#endif
@@ -0,0 +1,172 @@
+#include "lanes.h"
+#include "kernel.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SANDPILE_X86 1
+#endif
+
+// Vector j of row r starts at element lane_at(cols, r, j); rows -1 and strip
+// are the halo rows
+static inline size_t lane_at(int cols, int r, int j)
+{
+    return ((size_t)(r + 1) * cols + j) * LANES;
+}
+
+// The lanes do not interact until the halo exchange, so each ISA runs the pass
+// over parts of the GRID_ALIGN-byte vector as wide as its registers; GCC
+// splits wider generic vectors through the stack. The body is stamped out once
+// per part size.
+//
+// Topples are summed in 64-bit lanes. The cell-width lanes they are gathered
+// in first are flushed every 8 steps: in-place cells stay below CELL_MAX / 2
+// (see grid.h), so 8 spills of at most CELL_MAX / 8 still fit.
+#define DEFINE_RELAX(name, target, bytes)                                                                \
+    target static long name(cell_t *cells, const cell_t *live, int strip, int cols)                      \
+    {                                                                                                    \
+        enum { PART = (bytes) / (int)sizeof(cell_t) };                                                   \
+        typedef cell_t vec __attribute__((vector_size(bytes)));                                          \
+        typedef long long wide __attribute__((vector_size(PART * sizeof(long long))));                   \
+        wide total = {0};                                                                                \
+        for (int p = 0; p < LANES; p += PART)                                                            \
+            for (int r = 0; r < strip; r++)                                                              \
+            {                                                                                            \
+                cell_t *row = cells + lane_at(cols, r, 0) + p;                                           \
+                size_t span = (size_t)cols * LANES;                                                      \
+                /* Lanes past the grid's last row are sink and never topple */                           \
+                vec mask = *(const vec *)(live + (size_t)r * LANES + p);                                 \
+                /* carry: grains the previous cell pushed right; kept: its remainder, */                 \
+                /* stored once the cell to its right has pushed grains back */                           \
+                vec carry = {0}, kept = {0}, spilled = {0};                                              \
+                for (int j = 0; j < cols; j++)                                                           \
+                {                                                                                        \
+                    cell_t *at = row + (size_t)j * LANES;                                                \
+                    vec grains = (*(vec *)at + carry) & mask;                                            \
+                    carry = grains >> 2;                                                                 \
+                    if (j > 0)                                                                           \
+                        *(vec *)(at - LANES) = kept + carry;                                             \
+                    kept = grains & 3;                                                                   \
+                    *(vec *)(at - span) += carry;                                                        \
+                    *(vec *)(at + span) += carry;                                                        \
+                    spilled += carry;                                                                    \
+                    if ((j & 7) == 7)                                                                    \
+                    {                                                                                    \
+                        total += __builtin_convertvector(spilled, wide);                                 \
+                        spilled = (vec){0};                                                              \
+                    }                                                                                    \
+                }                                                                                        \
+                /* The last cell's right neighbour is the sink */                                        \
+                *(vec *)(row + (size_t)(cols - 1) * LANES) = kept;                                       \
+                total += __builtin_convertvector(spilled, wide);                                         \
+            }                                                                                            \
+                                                                                                         \
+        /* Halo grains go one lane over, into the first row of the strip below or the last row of the */ \
+        /* strip above: element k of a halo row is the cell of lane k, so reading it one element off */  \
+        /* shifts the lanes. The elements read past a vector belong to its neighbours in memory, and */  \
+        /* grains leaving the first and last lanes are the sink's; both are masked off. */               \
+        const cell_t *below = cells + lane_at(cols, strip, 0), *above = cells + lane_at(cols, -1, 0);    \
+        cell_t *first = cells + lane_at(cols, 0, 0), *last = cells + lane_at(cols, strip - 1, 0);        \
+        for (int p = 0; p < LANES; p += PART)                                                            \
+        {                                                                                                \
+            vec not_first, not_last;                                                                     \
+            for (int k = 0; k < PART; k++)                                                               \
+            {                                                                                            \
+                not_first[k] = p + k > 0 ? (cell_t)~(cell_t)0 : 0;                                       \
+                not_last[k] = p + k < LANES - 1 ? (cell_t)~(cell_t)0 : 0;                                \
+            }                                                                                            \
+            for (int j = 0; j < cols; j++)                                                               \
+            {                                                                                            \
+                size_t at = (size_t)j * LANES + p;                                                       \
+                vec from_above, from_below;                                                              \
+                memcpy(&from_above, below + at - 1, sizeof from_above);                                  \
+                memcpy(&from_below, above + at + 1, sizeof from_below);                                  \
+                *(vec *)(first + at) += from_above & not_first;                                          \
+                *(vec *)(last + at) += from_below & not_last;                                            \
+            }                                                                                            \
+        }                                                                                                \
+        memset(cells + lane_at(cols, -1, 0), 0, (size_t)cols * GRID_ALIGN);                              \
+        memset(cells + lane_at(cols, strip, 0), 0, (size_t)cols * GRID_ALIGN);                           \
+                                                                                                         \
+        long topples = 0;                                                                                \
+        for (int k = 0; k < PART; k++)                                                                   \
+            topples += total[k];                                                                         \
+        return topples;                                                                                  \
+    }
+
+DEFINE_RELAX(relax_scalar, , 16)
+
+#ifdef SANDPILE_X86
+DEFINE_RELAX(relax_avx2, __attribute__((target("avx2"))), 32)
+// The same instructions the row kernels are selected by: 32-bit cells need no
+// AVX-512 byte and word operations
+#if CELL_BITS == 32
+DEFINE_RELAX(relax_avx512, __attribute__((target("avx512f"))), 64)
+#else
+DEFINE_RELAX(relax_avx512, __attribute__((target("avx512f,avx512bw"))), 64)
+#endif
+#endif
+
+int lanes_init(lanes_t *l, const grid_t *g)
+{
+    l->rows = g->rows;
+    l->cols = g->cols;
+    l->strip = (g->rows + LANES - 1) / LANES;
+    l->cells = aligned_alloc(GRID_ALIGN, (size_t)(l->strip + 2) * l->cols * GRID_ALIGN);
+    l->live = aligned_alloc(GRID_ALIGN, (size_t)l->strip * GRID_ALIGN);
+    if (!l->cells || !l->live)
+    {
+        lanes_free(l);
+        return -1;
+    }
+    memset(l->cells, 0, (size_t)(l->strip + 2) * l->cols * GRID_ALIGN);
+    for (int r = 0; r < l->strip; r++)
+        for (int k = 0; k < LANES; k++)
+            l->live[(size_t)r * LANES + k] = k * l->strip + r < l->rows ? (cell_t)~(cell_t)0 : 0;
+
+    for (int i = 0; i < g->rows; i++)
+    {
+        cell_t *to = l->cells + lane_at(l->cols, i % l->strip, 0) + i / l->strip;
+        const cell_t *from = grid_row(g, i);
+        for (int j = 0; j < g->cols; j++)
+            to[(size_t)j * LANES] = from[j];
+    }
+
+    l->relax = relax_scalar;
+#ifdef SANDPILE_X86
+    switch (sandpile_kernel_isa())
+    {
+    case KERNEL_ISA_AVX512:
+        l->relax = relax_avx512;
+        break;
+    case KERNEL_ISA_AVX2:
+        l->relax = relax_avx2;
+        break;
+    }
+#endif
+    return 0;
+}
+
+void lanes_free(lanes_t *l)
+{
+    free(l->cells);
+    free(l->live);
+    l->cells = l->live = NULL;
+}
+
+long lanes_relax(lanes_t *l)
+{
+    return l->relax(l->cells, l->live, l->strip, l->cols);
+}
+
+void lanes_store(const lanes_t *l, grid_t *g)
+{
+    for (int i = 0; i < g->rows; i++)
+    {
+        const cell_t *from = l->cells + lane_at(l->cols, i % l->strip, 0) + i / l->strip;
+        cell_t *to = grid_row(g, i);
+        for (int j = 0; j < g->cols; j++)
+            to[j] = from[(size_t)j * LANES];
+    }
+}
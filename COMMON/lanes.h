@@ -0,0 +1,46 @@
+/*
+ * Vectorized in-place (Gauss-Seidel) passes.
+ *
+ * An in-place pass topples each cell into cells that are visited later in the
+ * same pass, so along a row it is inherently sequential. Instead of vectorizing
+ * along the row, the grid is cut into LANES horizontal strips of `strip` rows
+ * and stored interleaved: one GRID_ALIGN-byte vector holds the same cell of
+ * every strip. A pass then runs an ordinary row-by-row Gauss-Seidel pass over
+ * all strips at once, one vector per step, carrying the grains a cell pushes
+ * to its right neighbour in a register. Grains that leave a strip through its
+ * top or bottom collect in two halo rows and are handed to the neighbouring
+ * strip, one lane over, at the end of the pass.
+ *
+ * The result is the same stable grid and topple count as any other engine
+ * (the model is abelian), in about half the sweeps of the Jacobi scheme. The
+ * pass is written once with GCC vector types and built for AVX-512, AVX2 and
+ * the baseline ISA and picked by sandpile_kernel_isa (kernel.h), so
+ * SANDPILE_KERNEL=scalar|avx2|avx512 overrides the choice for both.
+ */
+
+#ifndef SANDPILE_LANES_H
+#define SANDPILE_LANES_H
+
+#include "grid.h"
+
+#define LANES (GRID_ALIGN / (int)sizeof(cell_t))
+
+typedef struct
+{
+    int rows, cols;
+    int strip;          // grid rows per lane; the last lanes may hold fewer
+    cell_t *cells;      // (strip + 2) * cols vectors: halo row, strip rows, halo row
+    cell_t *live;       // strip vectors: all ones in the lanes where that row exists
+    long (*relax)(cell_t *cells, const cell_t *live, int strip, int cols);
+} lanes_t;
+
+// Copies the interior of g into interleaved strips. Returns 0 on success.
+int lanes_init(lanes_t *l, const grid_t *g);
+void lanes_free(lanes_t *l);
+
+// One in-place pass over every strip; returns the number of topples.
+long lanes_relax(lanes_t *l);
+// Copies the strips back into the interior of g.
+void lanes_store(const lanes_t *l, grid_t *g);
+
+#endif
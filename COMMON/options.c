@@ -0,0 +1,96 @@
+#include "options.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Returns the argument matching --name, pointing *value at the text after '='
+static const char *find_option(int argc, char *argv[], const char *name, const char **value)
+{
+    size_t len = strlen(name);
+    for (int i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        if (strncmp(arg, "--", 2) != 0 || strncmp(arg + 2, name, len) != 0)
+            continue;
+        if (arg[2 + len] == '\0')
+        {
+            *value = NULL;
+            return arg;
+        }
+        if (arg[2 + len] == '=')
+        {
+            *value = arg + 3 + len;
+            return arg;
+        }
+    }
+    return NULL;
+}
+
+int opt_flag(int argc, char *argv[], const char *name)
+{
+    const char *value;
+    return find_option(argc, argv, name, &value) != NULL;
+}
+
+const char *opt_string(int argc, char *argv[], const char *name, const char *fallback)
+{
+    const char *value;
+    if (!find_option(argc, argv, name, &value) || !value)
+        return fallback;
+    return value;
+}
+
+long opt_long(int argc, char *argv[], const char *name, long fallback)
+{
+    const char *value = opt_string(argc, argv, name, NULL);
+    if (!value)
+        return fallback;
+
+    char *end;
+    long result = strtol(value, &end, 10);
+    if (end == value || *end != '\0')
+    {
+        fprintf(stderr, "Option --%s expects an integer, got '%s'\n", name, value);
+        exit(EXIT_FAILURE);
+    }
+    return result;
+}
+
+double opt_double(int argc, char *argv[], const char *name, double fallback)
+{
+    const char *value = opt_string(argc, argv, name, NULL);
+    if (!value)
+        return fallback;
+
+    char *end;
+    double result = strtod(value, &end);
+    if (end == value || *end != '\0')
+    {
+        fprintf(stderr, "Option --%s expects a number, got '%s'\n", name, value);
+        exit(EXIT_FAILURE);
+    }
+    return result;
+}
+
+int opt_check(int argc, char *argv[], const char *const known[])
+{
+    int unknown = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strncmp(argv[i], "--", 2) != 0)
+            continue;
+
+        size_t len = strcspn(argv[i] + 2, "=");
+        int found = 0;
+        for (int k = 0; known[k]; k++)
+            if (strlen(known[k]) == len && strncmp(argv[i] + 2, known[k], len) == 0)
+                found = 1;
+        if (!found)
+        {
+            fprintf(stderr, "Unknown option: %s\n", argv[i]);
+            unknown++;
+        }
+    }
+    return unknown;
+}
@@ -0,0 +1,21 @@
+/*
+ * Optional "--name" / "--name=value" switches that follow the positional
+ * N M input output arguments of every driver.
+ */
+
+#ifndef SANDPILE_OPTIONS_H
+#define SANDPILE_OPTIONS_H
+
+// Nonzero if "--name" or "--name=..." was given.
+int opt_flag(int argc, char *argv[], const char *name);
+// Value of "--name=value", or fallback if the option is absent.
+const char *opt_string(int argc, char *argv[], const char *name, const char *fallback);
+// Integer value of "--name=value", or fallback if absent. Exits on malformed input.
+long opt_long(int argc, char *argv[], const char *name, long fallback);
+// Floating point value of "--name=value", or fallback if absent. Exits on malformed input.
+double opt_double(int argc, char *argv[], const char *name, double fallback);
+// Reports every "--" argument that is not in the NULL terminated list of known
+// names to stderr. Returns the number of unknown options.
+int opt_check(int argc, char *argv[], const char *const known[]);
+
+#endif
@@ -0,0 +1,18 @@
+#include "stats.h"
+
+void stats_print(const run_stats_t *s, FILE *output)
+{
+    fprintf(output,
+            "{\"engine\": \"%s\", \"rows\": %d, \"cols\": %d, \"ranks\": %d, \"threads\": %d, "
+            "\"iterations\": %ld, \"topples\": %ld, \"seconds\": %.6f, ",
+            s->engine, s->rows, s->cols, s->ranks, s->threads, s->iterations, s->topples, s->seconds);
+    if (s->full_sweeps)
+        fprintf(output, "\"cell_updates_per_s\": %.6g, ",
+                s->seconds > 0.0 ? (double)s->rows * s->cols * s->iterations / s->seconds : 0.0);
+    else
+        fprintf(output, "\"cell_updates_per_s\": null, ");
+    fprintf(output, "\"topples_per_s\": %.6g", s->seconds > 0.0 ? s->topples / s->seconds : 0.0);
+    if (s->tasks > 0)
+        fprintf(output, ", \"tasks\": %ld", s->tasks);
+    fprintf(output, "}\n");
+}
@@ -0,0 +1,49 @@
+/*
+ * Machine-readable run summary (--stats).
+ *
+ * Every driver reports the same fields as one JSON object on a line of its
+ * own, so bench.py can collect serial, OpenMP and MPI runs into one table.
+ * Two throughputs are reported. Topples per second compares every engine: a
+ * grid takes the same topples to stabilize whatever the engine (the odometer
+ * is unique). Cell updates per second, rows x cols x iterations / seconds,
+ * needs an iteration to be a sweep of every cell; an iteration is a
+ * different amount of work per engine:
+ *
+ *   Jacobi engines (serial default, --active, --bitsliced, --symmetric and
+ *   --temporal, MPI, OpenMP --temporal)  one sweep of every cell
+ *   serial --inplace   one Gauss-Seidel pass over every cell
+ *   OpenMP default     one red and one black half-pass
+ *   OpenMP --tiled     one round in which every tile relaxes to stability
+ *   OpenMP --async     the most relax-and-post rounds of any thread
+ *   OpenMP --tasks     none; the tile tasks run are reported as "tasks"
+ *   omp-batch          as Jacobi, or as --tiled for grids shared by all threads
+ *
+ * so iteration counts only compare runs of one engine. Cell updates per second
+ * is reported for the Jacobi, --inplace, OpenMP default and Jacobi omp-batch
+ * runs, and is null for --tiled, --async, --tasks and tiled omp-batch runs.
+ */
+
+#ifndef SANDPILE_STATS_H
+#define SANDPILE_STATS_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+typedef struct
+{
+    const char *engine; // "serial", "omp" or "mpi"
+    int rows, cols;
+    int ranks, threads;
+    long iterations;    // engine's iterations until stable, see above
+    long topples;       // sum over cells of grains / 4 at every sweep
+    double seconds;     // time of the stabilization loop, I/O excluded
+    long tasks;         // tile tasks run by the task engine, 0 for the others
+    bool full_sweeps;   // an iteration updates every cell once
+} run_stats_t;
+
+// Writes s as {"engine": ..., "cell_updates_per_s": ..., "topples_per_s": ...}
+// followed by a newline; cell_updates_per_s is null unless full_sweeps is set,
+// and a "tasks" field is added when tasks is set.
+void stats_print(const run_stats_t *s, FILE *output);
+
+#endif
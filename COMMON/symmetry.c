@@ -0,0 +1,132 @@
+#include "symmetry.h"
+#include "kernel.h"
+
+#include <string.h>
+
+int symmetry_parse(const char *text)
+{
+    int flags = 0;
+    for (const char *p = text; *p; p++)
+    {
+        if (*p == 'h')
+            flags |= SYMMETRY_ROWS;
+        else if (*p == 'v')
+            flags |= SYMMETRY_COLS;
+        else if (*p == 'd')
+            flags |= SYMMETRY_DIAGONAL;
+        else
+            return -1;
+    }
+    return flags;
+}
+
+int symmetry_detect(const grid_t *g, int allowed)
+{
+    int flags = allowed;
+    if (g->rows != g->cols)
+        flags &= ~SYMMETRY_DIAGONAL;
+
+    for (int i = 0; i < g->rows && flags; i++)
+    {
+        const cell_t *row = grid_row(g, i);
+        const cell_t *mirror = grid_row(g, g->rows - 1 - i);
+        for (int j = 0; j < g->cols; j++)
+        {
+            if (row[j] != mirror[j])
+                flags &= ~SYMMETRY_ROWS;
+            if (row[j] != row[g->cols - 1 - j])
+                flags &= ~SYMMETRY_COLS;
+            if ((flags & SYMMETRY_DIAGONAL) && row[j] != GRID_AT(g, j, i))
+                flags &= ~SYMMETRY_DIAGONAL;
+        }
+    }
+    return flags;
+}
+
+void symmetry_init(symmetry_t *s, int N, int M, int flags)
+{
+    // The diagonal and one mirror together imply the other mirror, and the
+    // triangle of the quadrant is only a fundamental domain with all three
+    if ((flags & SYMMETRY_DIAGONAL) && (flags & (SYMMETRY_ROWS | SYMMETRY_COLS)))
+        flags |= SYMMETRY_ROWS | SYMMETRY_COLS;
+    s->flags = flags;
+    s->N = N;
+    s->M = M;
+    s->rows = flags & SYMMETRY_ROWS ? (N + 1) / 2 : N;
+    s->cols = flags & SYMMETRY_COLS ? (M + 1) / 2 : M;
+}
+
+void symmetry_fold(const symmetry_t *s, const grid_t *full, grid_t *domain)
+{
+    for (int i = 0; i < s->rows; i++)
+        memcpy(grid_row(domain, i), grid_row(full, i), (size_t)s->cols * sizeof(cell_t));
+}
+
+void symmetry_unfold(const symmetry_t *s, const grid_t *domain, grid_t *full)
+{
+    for (int i = 0; i < s->N; i++)
+    {
+        int fi = (s->flags & SYMMETRY_ROWS) && i >= s->rows ? s->N - 1 - i : i;
+        cell_t *row = grid_row(full, i);
+        for (int j = 0; j < s->M; j++)
+        {
+            int fj = (s->flags & SYMMETRY_COLS) && j >= s->cols ? s->M - 1 - j : j;
+            row[j] = (s->flags & SYMMETRY_DIAGONAL) && fj < fi ? GRID_AT(domain, fj, fi) : GRID_AT(domain, fi, fj);
+        }
+    }
+}
+
+// Fills the cells the domain's sweep reads outside it from their mirror
+// images: the subdiagonal first, since the mirror column can read from it
+static void reflect(const symmetry_t *s, grid_t *g)
+{
+    if (s->flags & SYMMETRY_DIAGONAL)
+        for (int i = 1; i < s->rows; i++)
+            GRID_AT(g, i, i - 1) = GRID_AT(g, i - 1, i);
+    if (s->flags & SYMMETRY_COLS)
+        for (int i = 0; i < s->rows; i++)
+            GRID_AT(g, i, s->cols) = GRID_AT(g, i, s->M - 1 - s->cols);
+    if (s->flags & SYMMETRY_ROWS)
+        memcpy(grid_row(g, s->rows), grid_row(g, s->N - 1 - s->rows), (size_t)s->cols * sizeof(cell_t));
+}
+
+static long sweep_span(const grid_t *cur, grid_t *next, int i, int c0, int c1, int copies)
+{
+    return c1 > c0 ? copies * sandpile_sweep(cur, next, i, i + 1, c0, c1, NULL) : 0;
+}
+
+long symmetry_sweep(const symmetry_t *s, grid_t *cur, grid_t *next)
+{
+    reflect(s, cur);
+
+    // A cell on a mirror axis or on the diagonal is its own image, so it
+    // stands for fewer cells of the full grid than the others
+    int diagonal = (s->flags & SYMMETRY_DIAGONAL) != 0;
+    int axis_row = (s->flags & SYMMETRY_ROWS) && s->N % 2 ? s->rows - 1 : -1;
+    int axis_col = (s->flags & SYMMETRY_COLS) && s->M % 2 ? s->cols - 1 : -1;
+    int row_copies = s->flags & SYMMETRY_ROWS ? 2 : 1;
+    int col_copies = s->flags & SYMMETRY_COLS ? 2 : 1;
+
+    long topples = 0;
+    for (int i = 0; i < s->rows; i++)
+    {
+        int copies = i == axis_row ? 1 : row_copies;
+        int start = 0;
+        if (diagonal)
+        {
+            topples += sweep_span(cur, next, i, i, i + 1, copies * (i == axis_col ? 1 : col_copies));
+            start = i + 1;
+            copies *= 2;
+        }
+        if (axis_col >= start)
+        {
+            topples += sweep_span(cur, next, i, start, axis_col, copies * col_copies);
+            topples += sweep_span(cur, next, i, axis_col, axis_col + 1, copies);
+        }
+        else
+        {
+            topples += sweep_span(cur, next, i, start, s->cols, copies * col_copies);
+        }
+    }
+    return topples;
+}
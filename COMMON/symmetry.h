@@ -0,0 +1,48 @@
+/*
+ * Stabilization of mirror-symmetric grids on their fundamental domain.
+ *
+ * A Jacobi sweep commutes with every symmetry of the rectangle, so a grid
+ * that is mirror symmetric about its horizontal or vertical centre line, or
+ * about the main diagonal of a square grid, stays so until it is stable. Only
+ * one copy of each orbit of cells then needs to be swept: the top half, the
+ * left half, the upper triangle, or with all three (the uniform inputs of
+ * grid_generator.py) the upper triangle of the top-left quadrant, 1/8 of the
+ * work. Before every sweep the cells just outside the domain are filled from
+ * their mirror images inside it, so the cut edges act as reflecting
+ * boundaries while the outer edges stay sinks.
+ */
+
+#ifndef SANDPILE_SYMMETRY_H
+#define SANDPILE_SYMMETRY_H
+
+#include "grid.h"
+
+#define SYMMETRY_ROWS 1     // row i equals row N - 1 - i
+#define SYMMETRY_COLS 2     // column j equals column M - 1 - j
+#define SYMMETRY_DIAGONAL 4 // cell (i, j) equals cell (j, i); square grids only
+
+typedef struct
+{
+    int flags;      // SYMMETRY_* bits in use
+    int N, M;       // size of the full grid
+    int rows, cols; // size of the grid that holds the domain
+} symmetry_t;
+
+// Parses "h" (horizontal axis, SYMMETRY_ROWS), "v" (vertical axis,
+// SYMMETRY_COLS) and "d" (diagonal) letters into flags; -1 on anything else.
+int symmetry_parse(const char *text);
+// Subset of the `allowed` symmetries that g actually has.
+int symmetry_detect(const grid_t *g, int allowed);
+
+void symmetry_init(symmetry_t *s, int N, int M, int flags);
+// Copies the domain of full into domain, a grid of s->rows x s->cols.
+void symmetry_fold(const symmetry_t *s, const grid_t *full, grid_t *domain);
+// Rebuilds every cell of full from domain.
+void symmetry_unfold(const symmetry_t *s, const grid_t *domain, grid_t *full);
+
+// One Jacobi sweep of the domain: refreshes the mirror cells around it in
+// cur, sweeps it into next and returns the topples of the whole grid, each
+// domain cell counted once for every cell of the full grid it stands for.
+long symmetry_sweep(const symmetry_t *s, grid_t *cur, grid_t *next);
+
+#endif
@@ -0,0 +1,125 @@
+#include "temporal.h"
+#include "kernel.h"
+
+#include <stdlib.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+int temporal_init(temporal_t *t, const grid_t *g, int steps)
+{
+    t->steps = steps;
+#ifdef _OPENMP
+    t->threads = omp_get_max_threads();
+#else
+    t->threads = 1;
+#endif
+
+    // Two scratch buffers of band_rows + 2 * steps rows should stay in cache,
+    // and every thread should get at least one band
+    long row_bytes = (long)grid_stride(g->cols) * sizeof(cell_t);
+    long rows = TEMPORAL_CACHE_BYTES / (2 * row_bytes) - 2L * steps;
+    long share = (g->rows + t->threads - 1) / t->threads;
+    if (rows > share)
+        rows = share;
+    if (rows < steps)
+        rows = steps;
+    t->band_rows = (int)rows;
+
+    t->scratch = calloc(2 * (size_t)t->threads, sizeof *t->scratch);
+    t->topples = calloc((size_t)t->threads * steps, sizeof *t->topples);
+    int failed = !t->scratch || !t->topples;
+    for (int k = 0; k < 2 * t->threads && !failed; k++)
+        failed = grid_alloc(&t->scratch[k], t->band_rows + 2 * steps, g->cols) != 0;
+    if (failed)
+    {
+        temporal_free(t);
+        return -1;
+    }
+    return 0;
+}
+
+void temporal_free(temporal_t *t)
+{
+    if (t->scratch)
+        for (int k = 0; k < 2 * t->threads; k++)
+            grid_free(&t->scratch[k]);
+    free(t->scratch);
+    free(t->topples);
+    t->scratch = NULL;
+    t->topples = NULL;
+}
+
+// Row r of the state after `step` steps while band r0 is being advanced:
+// cur for step 0, next for the last step, the scratch buffers in between.
+// Rows outside the grid are cur's zero border.
+static inline cell_t *state_row(const temporal_t *t, grid_t *scratch, const grid_t *cur, grid_t *next,
+                                int step, int r0, int r)
+{
+    if (step == 0 || r < 0 || r >= cur->rows)
+        return grid_row(cur, r);
+    if (step == t->steps)
+        return grid_row(next, r);
+    return grid_row(&scratch[step & 1], r - (r0 - t->steps));
+}
+
+static void advance_band(temporal_t *t, grid_t *scratch, const grid_t *cur, grid_t *next, int r0, long *topples)
+{
+    int T = t->steps, N = cur->rows, M = cur->cols;
+    int r1 = r0 + t->band_rows < N ? r0 + t->band_rows : N;
+    for (int s = 1; s <= T; s++)
+    {
+        int lo = r0 - T + s > 0 ? r0 - T + s : 0;
+        int hi = r1 + T - s < N ? r1 + T - s : N;
+        long owned = 0;
+        for (int r = lo; r < hi; r++)
+        {
+            long count = sandpile_sweep_row(state_row(t, scratch, cur, next, s - 1, r0, r - 1),
+                                            state_row(t, scratch, cur, next, s - 1, r0, r),
+                                            state_row(t, scratch, cur, next, s - 1, r0, r + 1),
+                                            state_row(t, scratch, cur, next, s, r0, r), M, NULL);
+            if (r >= r0 && r < r1)
+                owned += count;
+        }
+        topples[s - 1] += owned;
+    }
+}
+
+long temporal_sweep(temporal_t *t, const grid_t *cur, grid_t *next, int *sweeps, bool *stable)
+{
+    int N = cur->rows, T = t->steps;
+    int bands = (N + t->band_rows - 1) / t->band_rows;
+    for (int k = 0; k < t->threads * T; k++)
+        t->topples[k] = 0;
+    sandpile_kernel_init();
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 1)
+#endif
+    for (int b = 0; b < bands; b++)
+    {
+#ifdef _OPENMP
+        int thread = omp_get_thread_num();
+#else
+        int thread = 0;
+#endif
+        advance_band(t, &t->scratch[2 * thread], cur, next, b * t->band_rows, &t->topples[thread * T]);
+    }
+
+    long total = 0;
+    *stable = false;
+    *sweeps = T;
+    for (int s = 0; s < T && !*stable; s++)
+    {
+        long step = 0;
+        for (int k = 0; k < t->threads; k++)
+            step += t->topples[k * T + s];
+        total += step;
+        if (step == 0)
+        {
+            *stable = true;
+            *sweeps = s + 1;
+        }
+    }
+    return total;
+}
@@ -0,0 +1,52 @@
+/*
+ * Temporally blocked Jacobi sweeps.
+ *
+ * A plain sweep streams the whole grid through memory once per time step. Here
+ * the grid is cut into bands of rows that are advanced `steps` time steps at a
+ * time inside two cache-sized scratch buffers: to produce band rows
+ * [r0, r1) after T steps, step s (1 <= s <= T) computes rows
+ * [r0 - T + s, r1 + T - s) from the rows of step s - 1, a trapezoid that
+ * shrinks by a row per step on each side. The overlapping rows are computed
+ * redundantly by both neighbouring bands, (T - 1) / band rows of extra work,
+ * in exchange for reading cur and writing next once per T steps. The result is
+ * bit for bit the one of T single sweeps. Bands are independent, so with
+ * OpenMP they are shared out over the threads.
+ *
+ * Topples are counted per step over the rows each band owns, so the first
+ * step without topples, i.e. the sweep that finds the grid stable, is known
+ * exactly; steps beyond it leave a stable grid unchanged.
+ */
+
+#ifndef SANDPILE_TEMPORAL_H
+#define SANDPILE_TEMPORAL_H
+
+#include <stdbool.h>
+#include "grid.h"
+
+// Time steps per pass when the drivers' --temporal is given without a count
+#define TEMPORAL_STEPS 8
+// Bytes of scratch per thread the band height is chosen for (about an L2 cache)
+#define TEMPORAL_CACHE_BYTES (1024 * 1024)
+
+typedef struct
+{
+    int steps;        // time steps per pass
+    int band_rows;    // rows each band owns
+    int threads;
+    grid_t *scratch;  // two per thread, band_rows + 2 * steps rows each
+    long *topples;    // per thread and step, over the rows of the bands it advanced
+} temporal_t;
+
+// Sets up passes of `steps` time steps over grids of g's size. Returns 0 on
+// success, -1 if memory ran out.
+int temporal_init(temporal_t *t, const grid_t *g, int steps);
+void temporal_free(temporal_t *t);
+
+// Advances cur by t->steps Jacobi sweeps into next (cur is left untouched and
+// the caller swaps as usual). *sweeps receives the number of sweeps up to and
+// including the first one without topples, or t->steps if every one toppled,
+// and *stable whether such a sweep was found. Returns the topples of those
+// sweeps.
+long temporal_sweep(temporal_t *t, const grid_t *cur, grid_t *next, int *sweeps, bool *stable);
+
+#endif
@@ -0,0 +1,195 @@
+// clock_gettime under -std=c11
+#define _POSIX_C_SOURCE 200809L
+
+#include "trace.h"
+#include "options.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static const char *const wait_names[TRACE_WAITS] = {"halo wait", "reduction wait"};
+
+const char *trace_option(int argc, char *argv[])
+{
+    const char *path = opt_string(argc, argv, "trace", NULL);
+#ifndef SANDPILE_TRACE
+    if (path)
+    {
+        fprintf(stderr, "--trace needs a build with make TRACE=1; ignored\n");
+        path = NULL;
+    }
+#endif
+    return path;
+}
+
+double trace_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + 1e-9 * (double)ts.tv_nsec;
+}
+
+void trace_init(trace_t *t, int id, bool enabled)
+{
+    t->enabled = enabled;
+    t->id = id;
+    t->origin = trace_now();
+    t->records = NULL;
+    t->count = 0;
+    t->capacity = 0;
+}
+
+void trace_free(trace_t *t)
+{
+    free(t->records);
+    t->records = NULL;
+    t->count = t->capacity = 0;
+}
+
+void trace_begin(trace_t *t, long iteration)
+{
+    if (!t->enabled)
+        return;
+    if (t->count == t->capacity)
+    {
+        long capacity = t->capacity ? 2 * t->capacity : 1024;
+        trace_record_t *records = realloc(t->records, (size_t)capacity * sizeof *records);
+        if (!records)
+        {
+            fprintf(stderr, "Trace %d: out of memory, recording stopped\n", t->id);
+            t->enabled = false;
+            return;
+        }
+        t->records = records;
+        t->capacity = capacity;
+    }
+
+    trace_record_t *r = &t->records[t->count];
+    memset(r, 0, sizeof *r);
+    r->iteration = iteration;
+    r->start = trace_now() - t->origin;
+    r->unstable = -1;
+}
+
+void trace_wait_begin(trace_t *t, int kind)
+{
+    if (t->enabled)
+        t->records[t->count].wait_start[kind] = trace_now() - t->origin;
+}
+
+void trace_wait_end(trace_t *t, int kind)
+{
+    if (!t->enabled)
+        return;
+    trace_record_t *r = &t->records[t->count];
+    r->wait[kind] += trace_now() - t->origin - r->wait_start[kind];
+}
+
+void trace_scan(trace_t *t, const grid_t *g, int row0, int col0)
+{
+    if (!t->enabled)
+        return;
+    long unstable = 0;
+    int r0 = g->rows, r1 = 0, c0 = g->cols, c1 = 0;
+    for (int i = 0; i < g->rows; i++)
+    {
+        const cell_t *row = grid_row(g, i);
+        for (int j = 0; j < g->cols; j++)
+            if (row[j] >= 4)
+            {
+                unstable++;
+                r0 = i < r0 ? i : r0;
+                r1 = i + 1 > r1 ? i + 1 : r1;
+                c0 = j < c0 ? j : c0;
+                c1 = j + 1 > c1 ? j + 1 : c1;
+            }
+    }
+
+    trace_record_t *r = &t->records[t->count];
+    r->unstable = unstable;
+    if (unstable)
+    {
+        r->box[0] = row0 + r0;
+        r->box[1] = row0 + r1;
+        r->box[2] = col0 + c0;
+        r->box[3] = col0 + c1;
+    }
+}
+
+void trace_end(trace_t *t, long topples)
+{
+    if (!t->enabled)
+        return;
+    trace_record_t *r = &t->records[t->count++];
+    r->end = trace_now() - t->origin;
+    r->topples = topples;
+}
+
+static double compute_time(const trace_record_t *r)
+{
+    double compute = r->end - r->start;
+    for (int k = 0; k < TRACE_WAITS; k++)
+        compute -= r->wait[k];
+    return compute;
+}
+
+static void write_csv(FILE *output, const char *unit, const trace_t *traces, int n)
+{
+    fprintf(output, "%s,iteration,start_s,compute_s,halo_wait_s,reduce_wait_s,topples,unstable_cells,"
+                    "box_row_begin,box_row_end,box_col_begin,box_col_end\n",
+            unit);
+    for (int k = 0; k < n; k++)
+        for (long i = 0; i < traces[k].count; i++)
+        {
+            const trace_record_t *r = &traces[k].records[i];
+            fprintf(output, "%d,%ld,%.9f,%.9f,%.9f,%.9f,%ld,%ld,%d,%d,%d,%d\n", traces[k].id, r->iteration,
+                    r->start, compute_time(r), r->wait[TRACE_HALO], r->wait[TRACE_REDUCE], r->topples,
+                    r->unstable, r->box[0], r->box[1], r->box[2], r->box[3]);
+        }
+}
+
+// One complete ("X") event per iteration carrying the counters, and one per
+// wait nested inside it; times are in microseconds
+static void write_chrome(FILE *output, const char *unit, const trace_t *traces, int n)
+{
+    fprintf(output, "{\"traceEvents\": [\n");
+    const char *sep = "";
+    for (int k = 0; k < n; k++)
+    {
+        fprintf(output, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, \"tid\": %d, "
+                        "\"args\": {\"name\": \"%s %d\"}}",
+                sep, traces[k].id, unit, traces[k].id);
+        sep = ",\n";
+        for (long i = 0; i < traces[k].count; i++)
+        {
+            const trace_record_t *r = &traces[k].records[i];
+            fprintf(output, ",\n{\"name\": \"iteration\", \"ph\": \"X\", \"pid\": 0, \"tid\": %d, "
+                            "\"ts\": %.3f, \"dur\": %.3f, \"args\": {\"iteration\": %ld, \"compute_us\": %.3f, "
+                            "\"topples\": %ld, \"unstable_cells\": %ld, \"box\": [%d, %d, %d, %d]}}",
+                    traces[k].id, 1e6 * r->start, 1e6 * (r->end - r->start), r->iteration,
+                    1e6 * compute_time(r), r->topples, r->unstable, r->box[0], r->box[1], r->box[2], r->box[3]);
+            for (int w = 0; w < TRACE_WAITS; w++)
+                if (r->wait[w] > 0.0)
+                    fprintf(output, ",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 0, \"tid\": %d, "
+                                    "\"ts\": %.3f, \"dur\": %.3f}",
+                            wait_names[w], traces[k].id, 1e6 * r->wait_start[w], 1e6 * r->wait[w]);
+        }
+    }
+    fprintf(output, "\n]}\n");
+}
+
+int trace_write(const char *path, const char *unit, const trace_t *traces, int n)
+{
+    FILE *output = fopen(path, "w");
+    if (!output)
+        return -1;
+
+    size_t len = strlen(path);
+    if (len >= 5 && strcmp(path + len - 5, ".json") == 0)
+        write_chrome(output, unit, traces, n);
+    else
+        write_csv(output, unit, traces, n);
+    return fclose(output) == 0 ? 0 : -1;
+}
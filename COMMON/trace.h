@@ -0,0 +1,77 @@
+/*
+ * Optional per-iteration instrumentation (make TRACE=1).
+ *
+ * Every rank or thread keeps one record per iteration: when it started, how
+ * long it waited for halos and for the global reduction, the rest of the time
+ * as compute, the topples, and the number and bounding box of the cells that
+ * were unstable when it started. Call sites are wrapped in TRACE(...) and
+ * vanish from the default build; the types and trace.c are always built so
+ * that signatures do not depend on the flag. --trace=path writes the records
+ * as CSV, or as a Chrome trace (chrome://tracing, Perfetto) if the path ends
+ * in .json. Setup and output calls stay unwrapped; without TRACE=1 there are
+ * no records and they do nothing.
+ */
+
+#ifndef SANDPILE_TRACE_H
+#define SANDPILE_TRACE_H
+
+#include <stdbool.h>
+#include "grid.h"
+
+#ifdef SANDPILE_TRACE
+#define TRACE(...) __VA_ARGS__
+#else
+#define TRACE(...)
+#endif
+
+enum
+{
+    TRACE_HALO,   // waiting for ghost cells (MPI_Waitall, merge barriers)
+    TRACE_REDUCE, // waiting for the convergence verdict
+    TRACE_WAITS
+};
+
+typedef struct
+{
+    long iteration;
+    double start, end;            // seconds since the trace was initialised
+    double wait_start[TRACE_WAITS]; // start of the last wait of each kind
+    double wait[TRACE_WAITS];     // total length of the waits of each kind
+    long topples;
+    long unstable;                // cells holding 4 or more grains, -1 if not scanned
+    int box[4];                   // global row_begin, row_end, col_begin, col_end of them
+} trace_record_t;
+
+typedef struct
+{
+    bool enabled;
+    int id;                       // rank or thread number
+    double origin;
+    trace_record_t *records;      // records[count] is the one being filled
+    long count, capacity;
+} trace_t;
+
+// Path given with --trace=path, or NULL. Builds without TRACE=1 warn about
+// the option and return NULL.
+const char *trace_option(int argc, char *argv[]);
+
+// Monotonic wall time in seconds.
+double trace_now(void);
+
+// Starts an empty trace whose times count from now. A disabled trace ignores
+// every call below, as does one whose buffer could not grow.
+void trace_init(trace_t *t, int id, bool enabled);
+void trace_free(trace_t *t);
+
+void trace_begin(trace_t *t, long iteration);
+void trace_wait_begin(trace_t *t, int kind);
+void trace_wait_end(trace_t *t, int kind);
+// Counts the unstable cells of g and their bounding box, shifted by the
+// block's global position (row0, col0).
+void trace_scan(trace_t *t, const grid_t *g, int row0, int col0);
+void trace_end(trace_t *t, long topples);
+
+// Writes n traces, labelled by unit ("rank" or "thread"). Returns 0 on success.
+int trace_write(const char *path, const char *unit, const trace_t *traces, int n);
+
+#endif
@@ -0,0 +1,445 @@
+#include "decomp.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static void split(int n, int parts, int index, int *start, int *count)
+{
+    int base = n / parts;
+    int remainder = n % parts;
+    *count = base + (index < remainder ? 1 : 0);
+    *start = index * base + (index < remainder ? index : remainder);
+}
+
+// Process grid P x Q for an N x M grid: of the factor pairs of size that give
+// every rank a row and a column, the one whose cuts cross the fewest cells,
+// (P - 1) * M + (Q - 1) * N, so P:Q follows N:M. Row slabs win ties and are
+// left in dims when no pair fits.
+static void shape_dims(int size, int N, int M, int dims[2])
+{
+    dims[0] = size;
+    dims[1] = 1;
+    long best = -1;
+    for (int p = size; p >= 1; p--)
+    {
+        int q = size / p;
+        if (size % p != 0 || p > N || q > M)
+            continue;
+        long cut = (long)(p - 1) * M + (long)(q - 1) * N;
+        if (best < 0 || cut < best)
+        {
+            best = cut;
+            dims[0] = p;
+            dims[1] = q;
+        }
+    }
+}
+
+int decomp_init(decomp_t *d, MPI_Comm comm, int N, int M, int proc_rows, int proc_cols)
+{
+    int size;
+    MPI_Comm_size(comm, &size);
+
+    d->dims[0] = proc_rows;
+    d->dims[1] = proc_cols;
+    if (proc_rows == 0 && proc_cols == 0)
+        shape_dims(size, N, M, d->dims);
+    else if (MPI_Dims_create(size, 2, d->dims) != MPI_SUCCESS)
+        return -1;
+    if (d->dims[0] > N || d->dims[1] > M)
+        return -1;
+
+    int periods[2] = {0, 0};
+    MPI_Cart_create(comm, 2, d->dims, periods, 1, &d->comm);
+    MPI_Comm_rank(d->comm, &d->rank);
+    MPI_Comm_size(d->comm, &d->size);
+    MPI_Cart_coords(d->comm, d->rank, 2, d->coords);
+    MPI_Cart_shift(d->comm, 0, 1, &d->up, &d->down);
+    MPI_Cart_shift(d->comm, 1, 1, &d->left, &d->right);
+
+    d->N = N;
+    d->M = M;
+    d->row_starts = malloc((d->dims[0] + 1) * sizeof *d->row_starts);
+    if (!d->row_starts)
+        return -1;
+    for (int p = 0; p < d->dims[0]; p++)
+    {
+        int rows;
+        split(N, d->dims[0], p, &d->row_starts[p], &rows);
+    }
+    d->row_starts[d->dims[0]] = N;
+    decomp_block(d, d->rank, &d->row0, &d->rows, &d->col0, &d->cols);
+
+    // Every local grid of this rank has the same stride, so one column type fits all
+    MPI_Type_vector(d->rows, 1, grid_stride(d->cols), CELL_MPI_TYPE, &d->column);
+    MPI_Type_commit(&d->column);
+
+    MPI_Datatype contiguous;
+    MPI_Type_contiguous(d->cols, CELL_MPI_TYPE, &contiguous);
+    MPI_Type_create_resized(contiguous, 0, (MPI_Aint)grid_stride(d->cols) * sizeof(cell_t), &d->row);
+    MPI_Type_commit(&d->row);
+    MPI_Type_free(&contiguous);
+    return 0;
+}
+
+void decomp_free(decomp_t *d)
+{
+    MPI_Type_free(&d->column);
+    MPI_Type_free(&d->row);
+    MPI_Comm_free(&d->comm);
+    free(d->row_starts);
+}
+
+void decomp_block(const decomp_t *d, int rank, int *row0, int *rows, int *col0, int *cols)
+{
+    int coords[2];
+    MPI_Cart_coords(d->comm, rank, 2, coords);
+    *row0 = d->row_starts[coords[0]];
+    *rows = d->row_starts[coords[0] + 1] - *row0;
+    split(d->M, d->dims[1], coords[1], col0, cols);
+}
+
+void decomp_balance_rows(const decomp_t *d, const double *load, int min_rows, int *row_starts)
+{
+    int P = d->dims[0], N = d->N;
+
+    // Cost of every row of slab p; a slab that measured nothing still counts a little
+    double total = 0.0;
+    for (int p = 0; p < P; p++)
+        total += load[p];
+    double floor = total > 0.0 ? 1e-6 * total / N : 1.0;
+
+    double target = 0.0;
+    for (int p = 0; p < P; p++)
+    {
+        int rows = d->row_starts[p + 1] - d->row_starts[p];
+        double row_cost = load[p] / rows > floor ? load[p] / rows : floor;
+        target += row_cost * rows;
+    }
+    target /= P;
+
+    // Walk the rows and cut whenever a rank has its share, within the room
+    // the remaining ranks need
+    row_starts[0] = 0;
+    int p = 1, slab = 0;
+    double sum = 0.0;
+    for (int i = 0; i < N && p < P; i++)
+    {
+        while (i >= d->row_starts[slab + 1])
+            slab++;
+        int rows = d->row_starts[slab + 1] - d->row_starts[slab];
+        double row_cost = load[slab] / rows > floor ? load[slab] / rows : floor;
+
+        int lowest = row_starts[p - 1] + min_rows, highest = N - (P - p) * min_rows;
+        if (i >= lowest && (sum + 0.5 * row_cost >= target || i >= highest))
+        {
+            row_starts[p++] = i;
+            sum = 0.0;
+        }
+        sum += row_cost;
+    }
+    for (; p <= P; p++)
+        row_starts[p] = p == P ? N : row_starts[p - 1] + min_rows;
+}
+
+int decomp_repartition(decomp_t *d, const int *row_starts, grid_t *local)
+{
+    if (d->dims[1] != 1)
+        return -1;
+
+    int new_row0 = row_starts[d->rank], new_rows = row_starts[d->rank + 1] - new_row0;
+    grid_t moved;
+    int *counts = malloc(4 * d->size * sizeof *counts);
+    int failed = grid_alloc_halo(&moved, new_rows, local->cols, local->halo) != 0 || !counts;
+    MPI_Allreduce(MPI_IN_PLACE, &failed, 1, MPI_INT, MPI_LOR, d->comm);
+    if (failed)
+    {
+        grid_free(&moved);
+        free(counts);
+        return -1;
+    }
+
+    // Each rank sends the overlap of its old rows with every new slab and
+    // receives the overlap of its new rows with every old one, in whole rows
+    int *send_counts = counts, *send_displs = counts + d->size;
+    int *recv_counts = counts + 2 * d->size, *recv_displs = counts + 3 * d->size;
+    for (int p = 0; p < d->size; p++)
+    {
+        int lo = row_starts[p] > d->row0 ? row_starts[p] : d->row0;
+        int hi = row_starts[p + 1] < d->row0 + d->rows ? row_starts[p + 1] : d->row0 + d->rows;
+        send_counts[p] = hi > lo ? hi - lo : 0;
+        send_displs[p] = hi > lo ? lo - d->row0 : 0;
+
+        lo = d->row_starts[p] > new_row0 ? d->row_starts[p] : new_row0;
+        hi = d->row_starts[p + 1] < new_row0 + new_rows ? d->row_starts[p + 1] : new_row0 + new_rows;
+        recv_counts[p] = hi > lo ? hi - lo : 0;
+        recv_displs[p] = hi > lo ? lo - new_row0 : 0;
+    }
+    MPI_Alltoallv(grid_row(local, 0), send_counts, send_displs, d->row, grid_row(&moved, 0), recv_counts,
+                  recv_displs, d->row, d->comm);
+    free(counts);
+
+    grid_free(local);
+    *local = moved;
+    memcpy(d->row_starts, row_starts, (d->size + 1) * sizeof *row_starts);
+    d->row0 = new_row0;
+    d->rows = new_rows;
+    MPI_Type_free(&d->column);
+    MPI_Type_vector(d->rows, 1, grid_stride(d->cols), CELL_MPI_TYPE, &d->column);
+    MPI_Type_commit(&d->column);
+    return 0;
+}
+
+// Datatype selecting a rows x cols block at (row0, col0) of a bordered grid
+static MPI_Datatype block_type(const grid_t *g, int row0, int rows, int col0, int cols)
+{
+    int sizes[2] = {g->rows + 2 * g->halo, g->stride};
+    int subsizes[2] = {rows, cols};
+    int starts[2] = {row0 + g->halo, col0 + 1};
+    MPI_Datatype type;
+    MPI_Type_create_subarray(2, sizes, subsizes, starts, MPI_ORDER_C, CELL_MPI_TYPE, &type);
+    MPI_Type_commit(&type);
+    return type;
+}
+
+void decomp_scatter(const decomp_t *d, const grid_t *full, grid_t *local)
+{
+    MPI_Request *requests = NULL;
+    MPI_Datatype *types = NULL;
+    if (d->rank == 0)
+    {
+        requests = malloc(d->size * sizeof *requests);
+        types = malloc(d->size * sizeof *types);
+        for (int p = 0; p < d->size; p++)
+        {
+            int row0, rows, col0, cols;
+            decomp_block(d, p, &row0, &rows, &col0, &cols);
+            types[p] = block_type(full, row0, rows, col0, cols);
+            MPI_Isend(full->data, 1, types[p], p, 0, d->comm, &requests[p]);
+        }
+    }
+
+    MPI_Datatype interior = block_type(local, 0, local->rows, 0, local->cols);
+    MPI_Recv(local->data, 1, interior, 0, 0, d->comm, MPI_STATUS_IGNORE);
+    MPI_Type_free(&interior);
+
+    if (d->rank == 0)
+    {
+        MPI_Waitall(d->size, requests, MPI_STATUSES_IGNORE);
+        for (int p = 0; p < d->size; p++)
+            MPI_Type_free(&types[p]);
+        free(requests);
+        free(types);
+    }
+}
+
+void decomp_gather(const decomp_t *d, const grid_t *local, grid_t *full)
+{
+    MPI_Request *requests = NULL;
+    MPI_Datatype *types = NULL;
+    if (d->rank == 0)
+    {
+        requests = malloc(d->size * sizeof *requests);
+        types = malloc(d->size * sizeof *types);
+        for (int p = 0; p < d->size; p++)
+        {
+            int row0, rows, col0, cols;
+            decomp_block(d, p, &row0, &rows, &col0, &cols);
+            types[p] = block_type(full, row0, rows, col0, cols);
+            MPI_Irecv(full->data, 1, types[p], p, 0, d->comm, &requests[p]);
+        }
+    }
+
+    MPI_Datatype interior = block_type(local, 0, local->rows, 0, local->cols);
+    MPI_Send(local->data, 1, interior, 0, 0, d->comm);
+    MPI_Type_free(&interior);
+
+    if (d->rank == 0)
+    {
+        MPI_Waitall(d->size, requests, MPI_STATUSES_IGNORE);
+        for (int p = 0; p < d->size; p++)
+            MPI_Type_free(&types[p]);
+        free(requests);
+        free(types);
+    }
+}
+
+static MPI_Datatype cell_type(int cell_bytes)
+{
+    if (cell_bytes == (int)sizeof(cell_t))
+        return CELL_MPI_TYPE;
+    return cell_bytes == 1 ? MPI_UINT8_T : cell_bytes == 2 ? MPI_UINT16_T : MPI_UINT32_T;
+}
+
+// Loads the whole file on rank 0, where grid_narrow can topple piles too big
+// for the cells, and scatters the result
+static int read_bin_narrowed(const decomp_t *d, const char *path, grid_t *local, const grid_bin_header_t *header)
+{
+    grid_t full;
+    int status = 0;
+    if (d->rank == 0)
+    {
+        FILE *input = fopen(path, "rb");
+        grid_bin_header_t h;
+        if (!input || grid_alloc(&full, d->N, d->M) != 0 || grid_bin_read_header(input, &h) != 0 ||
+            grid_bin_read_wide(&full, input, header) != 0)
+            status = -1;
+        if (input)
+            fclose(input);
+    }
+    MPI_Bcast(&status, 1, MPI_INT, 0, d->comm);
+    if (status == 0)
+        decomp_scatter(d, &full, local);
+    if (d->rank == 0)
+        grid_free(&full);
+    return status;
+}
+
+// File view of this rank's block in the row-major N x M cell array after the header
+static void set_block_view(const decomp_t *d, MPI_File fh, MPI_Datatype cell)
+{
+    int sizes[2] = {d->N, d->M};
+    int subsizes[2] = {d->rows, d->cols};
+    int starts[2] = {d->row0, d->col0};
+    MPI_Datatype block;
+    MPI_Type_create_subarray(2, sizes, subsizes, starts, MPI_ORDER_C, cell, &block);
+    MPI_Type_commit(&block);
+    MPI_File_set_view(fh, GRID_BIN_HEADER_BYTES, cell, block, "native", MPI_INFO_NULL);
+    MPI_Type_free(&block);
+}
+
+int decomp_read_bin(const decomp_t *d, const char *path, grid_t *local, grid_bin_header_t *header)
+{
+    MPI_File fh;
+    if (MPI_File_open(d->comm, path, MPI_MODE_RDONLY, MPI_INFO_NULL, &fh) != MPI_SUCCESS)
+        return -1;
+
+    // Every rank reads the 24-byte header itself, so all reach the same verdict
+    unsigned char buf[GRID_BIN_HEADER_BYTES] = {0};
+    MPI_Offset file_size;
+    MPI_File_read_at_all(fh, 0, buf, GRID_BIN_HEADER_BYTES, MPI_BYTE, MPI_STATUS_IGNORE);
+    MPI_File_get_size(fh, &file_size);
+    if (grid_bin_decode_header(buf, header) != 0 || header->rows != d->N || header->cols != d->M ||
+        file_size < GRID_BIN_HEADER_BYTES + (MPI_Offset)d->N * d->M * header->cell_bytes)
+    {
+        MPI_File_close(&fh);
+        return -1;
+    }
+
+    MPI_Datatype cell = cell_type(header->cell_bytes);
+    set_block_view(d, fh, cell);
+    int status;
+    if (header->cell_bytes == (int)sizeof(cell_t))
+    {
+        // Cells of the grid's own width land straight in the local interior
+        MPI_Datatype interior = block_type(local, 0, local->rows, 0, local->cols);
+        status = MPI_File_read_at_all(fh, 0, local->data, 1, interior, MPI_STATUS_IGNORE);
+        MPI_Type_free(&interior);
+    }
+    else
+    {
+        size_t row_bytes = (size_t)local->cols * header->cell_bytes;
+        unsigned char *packed = malloc(row_bytes * local->rows);
+        status = MPI_File_read_at_all(fh, 0, packed, local->rows * local->cols, cell, MPI_STATUS_IGNORE);
+
+        // Cells wider than cell_t only fit if nobody holds a pile above CELL_SAFE
+        int too_big = header->cell_bytes > (int)sizeof(cell_t) &&
+                      grid_bin_max(packed, header->cell_bytes, (size_t)local->rows * local->cols) > CELL_SAFE;
+        MPI_Allreduce(MPI_IN_PLACE, &too_big, 1, MPI_INT, MPI_LOR, d->comm);
+        if (too_big)
+        {
+            free(packed);
+            MPI_File_close(&fh);
+            return read_bin_narrowed(d, path, local, header);
+        }
+
+        for (int i = 0; i < local->rows; i++)
+            grid_bin_unpack(packed + i * row_bytes, header->cell_bytes, grid_row(local, i), local->cols);
+        free(packed);
+    }
+    MPI_File_close(&fh);
+    return status == MPI_SUCCESS ? 0 : -1;
+}
+
+int decomp_write_bin(const decomp_t *d, const char *path, const grid_t *local, int cell_bytes, uint64_t iteration)
+{
+    MPI_File fh;
+    if (MPI_File_open(d->comm, path, MPI_MODE_WRONLY | MPI_MODE_CREATE, MPI_INFO_NULL, &fh) != MPI_SUCCESS)
+        return -1;
+    MPI_File_set_size(fh, GRID_BIN_HEADER_BYTES + (MPI_Offset)d->N * d->M * cell_bytes);
+
+    grid_bin_header_t header = {d->N, d->M, cell_bytes, iteration};
+    unsigned char buf[GRID_BIN_HEADER_BYTES];
+    grid_bin_encode_header(&header, buf);
+    int status = MPI_File_write_at_all(fh, 0, buf, d->rank == 0 ? GRID_BIN_HEADER_BYTES : 0, MPI_BYTE,
+                                       MPI_STATUS_IGNORE);
+
+    MPI_Datatype cell = cell_type(cell_bytes);
+    set_block_view(d, fh, cell);
+    if (cell_bytes == (int)sizeof(cell_t))
+    {
+        MPI_Datatype interior = block_type(local, 0, local->rows, 0, local->cols);
+        if (MPI_File_write_at_all(fh, 0, local->data, 1, interior, MPI_STATUS_IGNORE) != MPI_SUCCESS)
+            status = -1;
+        MPI_Type_free(&interior);
+    }
+    else
+    {
+        size_t row_bytes = (size_t)local->cols * cell_bytes;
+        unsigned char *packed = malloc(row_bytes * local->rows);
+        for (int i = 0; i < local->rows; i++)
+            grid_bin_pack(grid_row(local, i), cell_bytes, packed + i * row_bytes, local->cols);
+        if (MPI_File_write_at_all(fh, 0, packed, local->rows * local->cols, cell, MPI_STATUS_IGNORE) != MPI_SUCCESS)
+            status = -1;
+        free(packed);
+    }
+    MPI_File_close(&fh);
+    return status == MPI_SUCCESS ? 0 : -1;
+}
+
+int decomp_exchange_begin(const decomp_t *d, grid_t *local, MPI_Request *requests)
+{
+    int n = 0;
+    int rows = local->rows, cols = local->cols;
+
+    // Tags name the direction of travel: 0 up, 1 down, 2 left, 3 right
+    if (d->up != MPI_PROC_NULL)
+    {
+        MPI_Isend(grid_row(local, 0), cols, CELL_MPI_TYPE, d->up, 0, d->comm, &requests[n++]);
+        MPI_Irecv(grid_row(local, -1), cols, CELL_MPI_TYPE, d->up, 1, d->comm, &requests[n++]);
+    }
+    if (d->down != MPI_PROC_NULL)
+    {
+        MPI_Isend(grid_row(local, rows - 1), cols, CELL_MPI_TYPE, d->down, 1, d->comm, &requests[n++]);
+        MPI_Irecv(grid_row(local, rows), cols, CELL_MPI_TYPE, d->down, 0, d->comm, &requests[n++]);
+    }
+    if (d->left != MPI_PROC_NULL)
+    {
+        MPI_Isend(grid_row(local, 0), 1, d->column, d->left, 2, d->comm, &requests[n++]);
+        MPI_Irecv(grid_row(local, 0) - 1, 1, d->column, d->left, 3, d->comm, &requests[n++]);
+    }
+    if (d->right != MPI_PROC_NULL)
+    {
+        MPI_Isend(grid_row(local, 0) + cols - 1, 1, d->column, d->right, 3, d->comm, &requests[n++]);
+        MPI_Irecv(grid_row(local, 0) + cols, 1, d->column, d->right, 2, d->comm, &requests[n++]);
+    }
+    return n;
+}
+
+int decomp_exchange_rows_begin(const decomp_t *d, grid_t *local, int depth, MPI_Request *requests)
+{
+    int n = 0;
+    int rows = local->rows;
+
+    if (d->up != MPI_PROC_NULL)
+    {
+        MPI_Isend(grid_row(local, 0), depth, d->row, d->up, 0, d->comm, &requests[n++]);
+        MPI_Irecv(grid_row(local, -depth), depth, d->row, d->up, 1, d->comm, &requests[n++]);
+    }
+    if (d->down != MPI_PROC_NULL)
+    {
+        MPI_Isend(grid_row(local, rows - depth), depth, d->row, d->down, 1, d->comm, &requests[n++]);
+        MPI_Irecv(grid_row(local, rows), depth, d->row, d->down, 0, d->comm, &requests[n++]);
+    }
+    return n;
+}
@@ -0,0 +1,81 @@
+/*
+ * Block decomposition of the global grid over a 2D Cartesian process grid.
+ *
+ * The default row-slab split is the proc_cols = 1 case. Each rank holds its
+ * block in a bordered grid_t; the border rows and columns are the ghost cells.
+ * Row halos are contiguous slices of the buffer and column halos travel as a
+ * strided vector datatype, so no halo is ever packed by hand.
+ * Row slabs start out equal but can be moved later to follow the load.
+ */
+
+#ifndef SANDPILE_DECOMP_H
+#define SANDPILE_DECOMP_H
+
+#include <mpi.h>
+#include "grid.h"
+#include "grid_bin.h"
+
+// MPI datatype of one grid cell
+#if CELL_BITS == 8
+#define CELL_MPI_TYPE MPI_UINT8_T
+#elif CELL_BITS == 16
+#define CELL_MPI_TYPE MPI_UINT16_T
+#else
+#define CELL_MPI_TYPE MPI_INT
+#endif
+
+typedef struct
+{
+    MPI_Comm comm;             // Cartesian communicator, owned by the decomposition
+    int rank, size;            // rank and size within comm
+    int dims[2];               // process grid: rows x columns of ranks
+    int coords[2];             // this rank's position in the process grid
+    int N, M;                  // global grid size
+    int *row_starts;           // first global row of every process row, then N
+    int row0, col0;            // global position of the local block
+    int rows, cols;            // local block size
+    int up, down, left, right; // neighbour ranks or MPI_PROC_NULL
+    MPI_Datatype column;       // one interior column of a local grid
+    MPI_Datatype row;          // one interior row; consecutive rows step by the stride
+} decomp_t;
+
+// Builds the process grid. With proc_rows and proc_cols both 0 the shape
+// follows the grid's aspect ratio (row slabs if nothing else fits); with one
+// of them 0 MPI_Dims_create chooses the other. Returns 0 on success, -1 if the
+// grid cannot be split that way.
+int decomp_init(decomp_t *d, MPI_Comm comm, int N, int M, int proc_rows, int proc_cols);
+void decomp_free(decomp_t *d);
+
+// Extent of the block owned by a rank of the process grid.
+void decomp_block(const decomp_t *d, int rank, int *row0, int *rows, int *col0, int *cols);
+
+// Row partition of a row-slab decomposition (dims[1] == 1) that gives every
+// rank an equal share of the load, where load[p] is the cost rank p measured
+// over its current rows and is taken to be spread evenly over them. Every
+// rank keeps at least min_rows rows. Fills size + 1 entries of row_starts.
+void decomp_balance_rows(const decomp_t *d, const double *load, int min_rows, int *row_starts);
+// Collective: moves the rows of every rank's local grid to the partition
+// row_starts, reallocating local with the new row count and the same halo.
+// Row slabs only. Returns 0 on success on every rank.
+int decomp_repartition(decomp_t *d, const int *row_starts, grid_t *local);
+
+// Moves blocks between the full grid on rank 0 and every rank's local grid.
+// local must have been allocated with the block size of the calling rank.
+void decomp_scatter(const decomp_t *d, const grid_t *full, grid_t *local);
+void decomp_gather(const decomp_t *d, const grid_t *local, grid_t *full);
+
+// Collective MPI-IO on a binary grid file (grid_bin.h): every rank reads or
+// writes only its own block through a subarray file view. The read checks the
+// header against the global size and returns -1 on any mismatch; the write
+// stores cells of the given width. Both return 0 on success on every rank.
+int decomp_read_bin(const decomp_t *d, const char *path, grid_t *local, grid_bin_header_t *header);
+int decomp_write_bin(const decomp_t *d, const char *path, const grid_t *local, int cell_bytes, uint64_t iteration);
+
+// Starts the four-way ghost exchange on local and stores the requests; at most
+// 8 are needed. Interior edge cells are sent, ghost cells are received.
+int decomp_exchange_begin(const decomp_t *d, grid_t *local, MPI_Request *requests);
+// Starts an exchange of `depth` rows with the up and down neighbours only, for
+// grids allocated with at least that many halo rows; at most 4 requests.
+int decomp_exchange_rows_begin(const decomp_t *d, grid_t *local, int depth, MPI_Request *requests);
+
+#endif
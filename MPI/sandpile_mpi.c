@@ -4,6 +4,14 @@
  * This implementation distributes rows across MPI processes using domain decomposition.
  * Each process sends and receives boundary rows (ghost rows) to/from its top and bottom neighbour processes
  * to exchange boundary information during the stabilization process.
+ * With --cart the grid is split over a 2D process grid instead (see decomp.c), and ghost columns are
+ * exchanged with the left and right neighbours as well.
+ * The halo exchange is overlapped with the sweep of every cell that does not touch a ghost cell; only the
+ * edge rows and columns wait for MPI_Waitall.
+ * The hybrid build adds OpenMP threads inside each rank's sweeps (MPI_THREAD_FUNNELED).
+ * Binary (.spg) grids are loaded and stored with collective MPI-IO, each rank touching only its own block.
+ * Checkpoints (see checkpoint.h) are written the same way, so a run can be resumed on any number of ranks.
+ * With --rebalance the row slab boundaries follow the measured sweep time instead of splitting the area.
  *
  * Parallel Jacobi Algorithm(reference)
  * https://bpb-us-w2.wpmucdn.com/sites.brown.edu/dist/1/376/files/2022/04/Handout-10-Parallel-Jacobi-MPI-code.pdf
@@ -16,8 +24,21 @@
 #include <string.h>
 #include <png.h> // Requires libpng-dev
 #include <mpi.h>
-
-void write_png(const char *filename, int **grid, int N, int M)
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "grid.h"
+#include "kernel.h"
+#include "active.h"
+#include "options.h"
+#include "decomp.h"
+#include "affinity.h"
+#include "grid_bin.h"
+#include "checkpoint.h"
+#include "stats.h"
+#include "trace.h"
+
+void write_png(const char *filename, const grid_t *grid, int N, int M)
 {
     FILE *fp = fopen(filename, "wb");
     if (!fp)
@@ -50,7 +71,7 @@ void write_png(const char *filename, int **grid, int N, int M)
     {
         for (int x = 0; x < M; x++)
         {
-            int val = grid[y][x];
+            int val = GRID_AT(grid, y, x);
             switch (val)
             {
             case 0:
@@ -102,193 +123,604 @@ char *generate_output_filename(const char *input_filename)
     return output_filename;
 }
 
-int main(int argc, char *argv[])
+// This rank's per-iteration timeline (--trace) and total time blocked on
+// halos; file scope so that the helpers below can time their own waits
+static trace_t trace;
+static double halo_wait;
+
+static void wait_halo(int count, MPI_Request *requests)
 {
-    MPI_Init(&argc, &argv);
+    TRACE(trace_wait_begin(&trace, TRACE_HALO));
+    double start = MPI_Wtime();
+    MPI_Waitall(count, requests, MPI_STATUSES_IGNORE);
+    halo_wait += MPI_Wtime() - start;
+    TRACE(trace_wait_end(&trace, TRACE_HALO));
+}
 
-    int rank, size;
-    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
-    MPI_Comm_size(MPI_COMM_WORLD, &size);
+// sandpile_sweep with the rows shared among the OpenMP threads of the hybrid
+// build; a plain call otherwise. Only called from the thread that does MPI.
+static long sweep_rows(const grid_t *cur, grid_t *next, int r0, int r1, int c0, int c1)
+{
+#ifdef _OPENMP
+    long topples = 0;
+    #pragma omp parallel for schedule(static) reduction(+:topples) if (r1 - r0 > 1)
+    for (int i = r0; i < r1; i++)
+        topples += sandpile_sweep(cur, next, i, i + 1, c0, c1, NULL);
+    return topples;
+#else
+    return sandpile_sweep(cur, next, r0, r1, c0, c1, NULL);
+#endif
+}
+
+// Rectangle of the local block that does not depend on any received ghost cell
+static void inner_bounds(const decomp_t *d, const grid_t *g, int *r0, int *r1, int *c0, int *c1)
+{
+    *r0 = d->up != MPI_PROC_NULL ? 1 : 0;
+    *r1 = d->down != MPI_PROC_NULL ? g->rows - 1 : g->rows;
+    *c0 = d->left != MPI_PROC_NULL ? 1 : 0;
+    *c1 = d->right != MPI_PROC_NULL ? g->cols - 1 : g->cols;
+    if (*r1 < *r0)
+        *r1 = *r0;
+    if (*c1 < *c0)
+        *c1 = *c0;
+}
+
+static long sweep_inner(const decomp_t *d, const grid_t *cur, grid_t *next)
+{
+    int r0, r1, c0, c1;
+    inner_bounds(d, cur, &r0, &r1, &c0, &c1);
+    return sweep_rows(cur, next, r0, r1, c0, c1);
+}
+
+// Sweeps the frame left over by sweep_inner once the ghost cells have arrived
+static long sweep_edges(const decomp_t *d, const grid_t *cur, grid_t *next)
+{
+    int r0, r1, c0, c1;
+    inner_bounds(d, cur, &r0, &r1, &c0, &c1);
+    long topples = sandpile_sweep(cur, next, 0, r0, 0, cur->cols, NULL);
+    topples += sandpile_sweep(cur, next, r1, cur->rows, 0, cur->cols, NULL);
+    topples += sandpile_sweep(cur, next, r0, r1, 0, c0, NULL);
+    topples += sandpile_sweep(cur, next, r0, r1, c1, cur->cols, NULL);
+    return topples;
+}
+
+// Global convergence test. The blocking form reduces every step's activity
+// straight away. The asynchronous form starts an MPI_Iallreduce and only
+// waits for it one step later, so the reduction overlaps the next sweep. Every
+// rank waits at the same step, so all of them see the same verdict and stop
+// together; the one speculative sweep past stability is a no-op.
+// The same reduction carries each rank's checkpoint request, so all ranks
+// agree on when to write one even though their clocks differ.
+typedef struct
+{
+    MPI_Comm comm;
+    bool async;
+    bool pending;             // an MPI_Iallreduce is in flight
+    bool send[2], recv[2];    // its buffers: changed, checkpoint wanted
+    MPI_Request request;
+} convergence_t;
+
+static void convergence_init(convergence_t *c, MPI_Comm comm, bool async)
+{
+    c->comm = comm;
+    c->async = async;
+    c->pending = false;
+}
 
-    if (argc != 5)
+// Reports this step's local activity; returns true once the grid is known to
+// be stable. *checkpoint goes in as this rank's request and comes out true if
+// any rank asked (one step late in the asynchronous form).
+static bool convergence_step(convergence_t *c, bool local_changed, bool *checkpoint)
+{
+    bool local[2] = {local_changed, *checkpoint};
+    if (!c->async)
     {
-        if (rank == 0)
-            fprintf(stderr, "Usage: %s N M input.txt image.png\n", argv[0]);
-        MPI_Finalize();
-        return EXIT_FAILURE;
+        bool global[2];
+        MPI_Allreduce(local, global, 2, MPI_C_BOOL, MPI_LOR, c->comm);
+        *checkpoint = global[1];
+        return !global[0];
     }
 
-    int N = atoi(argv[1]);
-    int M = atoi(argv[2]);
-    const char *input_filename = argv[3];
-    const char *image_filename = argv[4];
+    *checkpoint = false;
+    if (c->pending)
+    {
+        MPI_Wait(&c->request, MPI_STATUS_IGNORE);
+        c->pending = false;
+        // Nothing toppled anywhere in the previous step, so this one changed nothing either
+        if (!c->recv[0])
+            return true;
+        *checkpoint = c->recv[1];
+    }
 
-    // Calculate domain decomposition
-    int rows_per_proc = N / size;
-    int remainder = N % size;
-    int local_rows = rows_per_proc + (rank < remainder ? 1 : 0);
+    c->send[0] = local[0];
+    c->send[1] = local[1];
+    MPI_Iallreduce(c->send, c->recv, 2, MPI_C_BOOL, MPI_LOR, c->comm, &c->request);
+    c->pending = true;
+    return false;
+}
 
-    // Allocate local grid with ghost rows
-    int **local_grid = malloc((local_rows + 2) * sizeof(int *));
-    int **local_next = malloc((local_rows + 2) * sizeof(int *));
-    for (int i = 0; i < local_rows + 2; i++)
+// Runs `depth` sweeps of a row slab from a single exchange of `depth` ghost
+// rows. The ghost rows are recomputed redundantly, one fewer per sweep, so the
+// owned rows end up exactly as after `depth` ordinary iterations. Swaps the
+// buffers after every sweep; *last receives the owned topples of the final one.
+static long sweep_deep_halo(const decomp_t *d, grid_t *cur, grid_t *next, int depth, long *last)
+{
+    MPI_Request requests[4];
+    int req_count = decomp_exchange_rows_begin(d, cur, depth, requests);
+    int rows = cur->rows, cols = cur->cols;
+
+    // The first sweep's inner rows do not need the incoming halo
+    int r0, r1, c0, c1;
+    inner_bounds(d, cur, &r0, &r1, &c0, &c1);
+    long owned = sweep_rows(cur, next, r0, r1, 0, cols);
+    wait_halo(req_count, requests);
+
+    long total = 0;
+    for (int s = 0; s < depth; s++)
     {
-        local_grid[i] = calloc(M, sizeof(int));
-        local_next[i] = calloc(M, sizeof(int));
+        int extra = depth - 1 - s;
+        int lo = d->up != MPI_PROC_NULL ? -extra : 0;
+        int hi = d->down != MPI_PROC_NULL ? rows + extra : rows;
+
+        if (s == 0)
+            owned += sandpile_sweep(cur, next, 0, r0, 0, cols, NULL) +
+                     sandpile_sweep(cur, next, r1, rows, 0, cols, NULL);
+        else
+            owned = sweep_rows(cur, next, 0, rows, 0, cols);
+
+        // Redundant ghost rows; their topples belong to the neighbours
+        sandpile_sweep(cur, next, lo, 0, 0, cols, NULL);
+        sandpile_sweep(cur, next, rows, hi, 0, cols, NULL);
+
+        total += owned;
+        *last = owned;
+        grid_swap(cur, next);
     }
+    return total;
+}
 
-    // Read and distribute initial grid
-    int **full_grid = NULL;
-    if (rank == 0)
+// Collective: every rank writes its block of the checkpoint, then rank 0 moves
+// the finished file into place. A failed write leaves the previous checkpoint
+// and the run goes on.
+static void write_checkpoint(const decomp_t *d, checkpoint_t *c, const grid_t *local, uint64_t iteration, long sweeps)
+{
+    int status = decomp_write_bin(d, c->tmp_path, local, (int)sizeof(cell_t), iteration);
+    if (status == 0 && d->rank == 0)
+        status = checkpoint_commit(c);
+    if (status != 0 && d->rank == 0)
+        fprintf(stderr, "Failed to write checkpoint %s\n", c->path);
+    checkpoint_mark(c, sweeps, MPI_Wtime());
+}
+
+// Collects the records of every rank on rank 0 and writes them as one trace
+static void write_traces(const decomp_t *d, const trace_t *own, const char *path)
+{
+    int bytes = (int)(own->count * (long)sizeof(trace_record_t));
+    int *counts = NULL, *displs = NULL;
+    trace_record_t *records = NULL;
+    if (d->rank == 0)
     {
-        FILE *input = fopen(input_filename, "r");
-        if (!input)
+        counts = malloc((size_t)d->size * sizeof *counts);
+        displs = malloc((size_t)d->size * sizeof *displs);
+        if (!counts || !displs)
         {
-            perror("fopen input");
-            MPI_Finalize();
-            return EXIT_FAILURE;
+            fprintf(stderr, "Trace allocation failed\n");
+            MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
         }
+    }
+    MPI_Gather(&bytes, 1, MPI_INT, counts, 1, MPI_INT, 0, d->comm);
 
-        full_grid = malloc(N * sizeof(int *));
-        for (int i = 0; i < N; i++)
+    long total = 0;
+    if (d->rank == 0)
+    {
+        for (int k = 0; k < d->size; k++)
         {
-            full_grid[i] = malloc(M * sizeof(int));
-            for (int j = 0; j < M; j++)
-                fscanf(input, "%d", &full_grid[i][j]);
+            displs[k] = (int)total;
+            total += counts[k];
+        }
+        records = malloc(total > 0 ? (size_t)total : 1);
+        if (!records)
+        {
+            fprintf(stderr, "Trace allocation failed\n");
+            MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
         }
-        fclose(input);
     }
+    MPI_Gatherv(own->records, bytes, MPI_BYTE, records, counts, displs, MPI_BYTE, 0, d->comm);
 
-    // Scatter initial data to all processes
-    int *sendbuf = NULL;
-    int *sendcounts = malloc(size * sizeof(int));
-    int *displs = malloc(size * sizeof(int));
-
-    if (rank == 0)
+    if (d->rank == 0)
     {
-        sendbuf = malloc(N * M * sizeof(int));
-        for (int i = 0; i < N; i++)
-            for (int j = 0; j < M; j++)
-                sendbuf[i * M + j] = full_grid[i][j];
-
-        // Calculate send counts and displacements
-        int offset = 0;
-        for (int p = 0; p < size; p++)
+        trace_t *all = malloc((size_t)d->size * sizeof *all);
+        if (!all)
         {
-            int p_rows = rows_per_proc + (p < remainder ? 1 : 0);
-            sendcounts[p] = p_rows * M;
-            displs[p] = offset;
-            offset += sendcounts[p];
+            fprintf(stderr, "Trace allocation failed\n");
+            MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
         }
+        for (int k = 0; k < d->size; k++)
+        {
+            all[k] = (trace_t){true, k, 0.0, (trace_record_t *)((char *)records + displs[k]), 0, 0};
+            all[k].count = all[k].capacity = counts[k] / (long)sizeof(trace_record_t);
+        }
+        if (trace_write(path, "rank", all, d->size) != 0)
+            fprintf(stderr, "Failed to write trace %s\n", path);
+        free(all);
+        free(records);
+        free(counts);
+        free(displs);
     }
+}
 
-    int *recvbuf = malloc(local_rows * M * sizeof(int));
-    MPI_Scatterv(sendbuf, sendcounts, displs, MPI_INT, recvbuf, local_rows * M, MPI_INT, 0, MPI_COMM_WORLD);
+// Default --rebalance interval in sweeps, and the imbalance (slowest rank over
+// the mean) below which the slabs are left alone
+#define REBALANCE_SWEEPS 100
+#define REBALANCE_TOLERANCE 1.1
 
-    // Copy received data to local grid (skip ghost row 0)
-    for (int i = 0; i < local_rows; i++)
-        for (int j = 0; j < M; j++)
-            local_grid[i + 1][j] = recvbuf[i * M + j];
+// Collective: shares out the sweep time every rank measured since the last
+// call and, if the slowest rank is too far above the mean, moves the slab
+// boundaries to even it out. Both buffers are reallocated for the new slab.
+// Returns true if the slabs moved.
+static bool rebalance_slabs(decomp_t *d, double busy, int min_rows, grid_t *cur, grid_t *next)
+{
+    double *load = malloc((size_t)d->size * sizeof *load);
+    int *row_starts = malloc(((size_t)d->size + 1) * sizeof *row_starts);
+    if (!load || !row_starts)
+    {
+        fprintf(stderr, "Rank %d: rebalance allocation failed\n", d->rank);
+        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    }
+    MPI_Allgather(&busy, 1, MPI_DOUBLE, load, 1, MPI_DOUBLE, d->comm);
 
-    // Determine neighbors
-    int prev_rank = (rank == 0) ? MPI_PROC_NULL : rank - 1;
-    int next_rank = (rank == size - 1) ? MPI_PROC_NULL : rank + 1;
+    double total = 0.0, slowest = 0.0;
+    for (int p = 0; p < d->size; p++)
+    {
+        total += load[p];
+        slowest = load[p] > slowest ? load[p] : slowest;
+    }
 
-    MPI_Barrier(MPI_COMM_WORLD); // Ensure all processes are synchronized before starting
-    // Start mpi timing
-    double start_time = MPI_Wtime();
+    // Every rank holds the same loads, so all of them take the same decision
+    bool moved = false;
+    if (slowest > REBALANCE_TOLERANCE * total / d->size)
+    {
+        // Go halfway: the load is only known per slab, so the first estimate
+        // overshoots wherever the work sits in part of a slab
+        decomp_balance_rows(d, load, min_rows, row_starts);
+        for (int p = 1; p < d->size; p++)
+            row_starts[p] = (row_starts[p] + d->row_starts[p] + 1) / 2;
+        moved = memcmp(row_starts, d->row_starts, ((size_t)d->size + 1) * sizeof *row_starts) != 0;
+    }
+    if (moved)
+    {
+        if (decomp_repartition(d, row_starts, cur) != 0)
+        {
+            fprintf(stderr, "Rank %d: rebalance failed\n", d->rank);
+            MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+        }
+        int halo = next->halo;
+        grid_free(next);
+        if (grid_alloc_halo(next, d->rows, d->cols, halo) != 0)
+        {
+            fprintf(stderr, "Rank %d: grid allocation failed\n", d->rank);
+            MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+        }
+    }
+    free(load);
+    free(row_starts);
+    return moved;
+}
 
-    bool global_changed = true;
+// Applies the affinity policy to this rank within its node and reports on
+// rank 0 what was done there
+static void bind_rank(const decomp_t *d, int policy)
+{
+    MPI_Comm node;
+    int slot, slots;
+    MPI_Comm_split_type(d->comm, MPI_COMM_TYPE_SHARED, d->rank, MPI_INFO_NULL, &node);
+    MPI_Comm_rank(node, &slot);
+    MPI_Comm_size(node, &slots);
+    MPI_Comm_free(&node);
+
+#ifdef _OPENMP
+    int threads = omp_get_max_threads();
+#else
+    int threads = 1;
+#endif
+    char placement[256];
+    int failed = affinity_bind_process(policy, slot, slots, threads) != 0;
+    if (!failed)
+        failed = affinity_bind_threads(policy, placement, sizeof placement) != 0;
+#ifndef _OPENMP
+    // A single-threaded rank is pinned as a whole
+    if (!failed && policy != AFFINITY_NONE)
+        snprintf(placement, sizeof placement, "rank pinned");
+#endif
+
+    int any_failed;
+    MPI_Allreduce(&failed, &any_failed, 1, MPI_INT, MPI_LOR, d->comm);
+    if (d->rank == 0)
+    {
+        if (any_failed)
+            printf("Affinity: %s could not be applied on every rank, placement left to the runtime\n",
+                   affinity_name(policy));
+        else
+            printf("Affinity: %s, %d ranks on this node, %d threads each (rank 0: %s)\n", affinity_name(policy),
+                   slots, threads, placement);
+    }
+}
 
-    while (global_changed)
+int main(int argc, char *argv[])
+{
+    // The hybrid build (make hybrid) sweeps with OpenMP threads, but only the
+    // main thread ever calls MPI
+    int provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+
+    int rank, size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    sandpile_kernel_init();
+#ifdef _OPENMP
+    if (provided < MPI_THREAD_FUNNELED)
     {
+        if (rank == 0)
+            fprintf(stderr, "The MPI library does not support MPI_THREAD_FUNNELED\n");
+        MPI_Finalize();
+        return EXIT_FAILURE;
+    }
+#endif
 
-        // Exchange ghost rows
-        MPI_Request requests[4];
-        int req_count = 0;
+    static const char *const known_options[] = {"active", "cart", "halo-depth", "async-convergence", "checkpoint",
+                                                "checkpoint-every", "checkpoint-seconds", "restart", "stats", "trace", "rebalance",
+                                                "affinity", NULL};
+    if (argc < 5 || opt_check(argc, argv, known_options) != 0)
+    {
+        if (rank == 0)
+            fprintf(stderr,
+                    "Usage: %s N M input.txt|input.spg image.png|- [--active] [--cart[=PxQ]] [--halo-depth=k]"
+                    " [--async-convergence] [--checkpoint=path] [--checkpoint-every=N] [--checkpoint-seconds=T]"
+                    " [--restart] [--stats] [--trace=path] [--rebalance[=K]] [--affinity=none|close|spread]\n",
+                    argv[0]);
+        MPI_Finalize();
+        return EXIT_FAILURE;
+    }
 
-        // Send top boundary, receive into bottom ghost row
-        if (prev_rank != MPI_PROC_NULL)
-        {
-            MPI_Isend(local_grid[1], M, MPI_INT, prev_rank, 0, MPI_COMM_WORLD, &requests[req_count++]);
-            MPI_Irecv(local_grid[0], M, MPI_INT, prev_rank, 1, MPI_COMM_WORLD, &requests[req_count++]);
-        }
+    int N = atoi(argv[1]);
+    int M = atoi(argv[2]);
+    const char *input_filename = argv[3];
+    const char *image_filename = argv[4];
 
-        // Send bottom boundary, receive into top ghost row
-        if (next_rank != MPI_PROC_NULL)
+    // Domain decomposition: row slabs by default, --cart for a 2D process
+    // grid (shaped after N:M unless given as --cart=PxQ)
+    int proc_rows = size, proc_cols = 1;
+    if (opt_flag(argc, argv, "cart"))
+    {
+        const char *shape = opt_string(argc, argv, "cart", NULL);
+        proc_rows = proc_cols = 0;
+        if (shape && (sscanf(shape, "%dx%d", &proc_rows, &proc_cols) != 2 || proc_rows * proc_cols != size))
         {
-            MPI_Isend(local_grid[local_rows], M, MPI_INT, next_rank, 1, MPI_COMM_WORLD, &requests[req_count++]);
-            MPI_Irecv(local_grid[local_rows + 1], M, MPI_INT, next_rank, 0, MPI_COMM_WORLD, &requests[req_count++]);
+            if (rank == 0)
+                fprintf(stderr, "--cart=%s does not describe a grid of %d processes\n", shape, size);
+            MPI_Finalize();
+            return EXIT_FAILURE;
         }
+    }
 
-        MPI_Waitall(req_count, requests, MPI_STATUSES_IGNORE);
+    decomp_t decomp;
+    if (decomp_init(&decomp, MPI_COMM_WORLD, N, M, proc_rows, proc_cols) != 0)
+    {
+        if (rank == 0)
+            fprintf(stderr, "Cannot split a %d x %d grid over %d processes\n", N, M, size);
+        MPI_Finalize();
+        return EXIT_FAILURE;
+    }
+    rank = decomp.rank;
+    int local_rows = decomp.rows;
+    int local_cols = decomp.cols;
+
+    // --halo-depth=k: keep k ghost rows and run k sweeps per exchange and
+    // convergence check (row slabs only)
+    bool use_active = opt_flag(argc, argv, "active");
+    int depth = (int)opt_long(argc, argv, "halo-depth", 1);
+    if (depth < 1 || (depth > 1 && (decomp.dims[1] != 1 || use_active || N / decomp.dims[0] < depth)))
+    {
+        if (rank == 0)
+            fprintf(stderr, "--halo-depth=%d needs row slabs of at least %d rows and no --active\n", depth, depth);
+        MPI_Finalize();
+        return EXIT_FAILURE;
+    }
 
-        // Clear next grid
-        for (int i = 0; i < local_rows + 2; i++)
-            for (int j = 0; j < M; j++)
-                local_next[i][j] = 0;
+    // --rebalance[=K]: every K sweeps move the row slab boundaries so that
+    // every rank gets an equal share of the measured sweep time (row slabs only)
+    long rebalance = opt_flag(argc, argv, "rebalance") ? opt_long(argc, argv, "rebalance", REBALANCE_SWEEPS) : 0;
+    if (rebalance < 0 || (rebalance > 0 && decomp.dims[1] != 1))
+    {
+        if (rank == 0)
+            fprintf(stderr, "--rebalance needs row slabs and a positive interval\n");
+        MPI_Finalize();
+        return EXIT_FAILURE;
+    }
 
-        bool local_changed = false;
+    // --affinity=close|spread: pin the rank to its share of the node's CPUs
+    // (and in the hybrid build each thread to one of them) before the local
+    // grids are first touched
+    int affinity = affinity_parse(opt_string(argc, argv, "affinity", "none"));
+    if (affinity < 0)
+    {
+        if (rank == 0)
+            fprintf(stderr, "--affinity takes none, close or spread\n");
+        MPI_Finalize();
+        return EXIT_FAILURE;
+    }
+    bind_rank(&decomp, affinity);
 
-        // Process local cells (excluding ghost rows)
-        for (int i = 1; i <= local_rows; i++)
-        {
-            for (int j = 0; j < M; j++)
-            {
-                int grains = local_grid[i][j];
-                int keep = grains % 4;
-                int distribute = grains / 4;
+    // Allocate local grid; its border rows and columns are the ghost cells
+    grid_t local_grid, local_next;
+    if (grid_alloc_first_touch(&local_grid, local_rows, local_cols, depth) != 0 ||
+        grid_alloc_first_touch(&local_next, local_rows, local_cols, depth) != 0)
+    {
+        fprintf(stderr, "Rank %d: grid allocation failed\n", rank);
+        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    }
 
-                local_next[i][j] += keep;
+    // A binary (.spg) input is read slab by slab with MPI-IO and the result is
+    // written back the same way; rank 0 only assembles the full grid for the
+    // text format and for the image, which "-" skips
+    int binary = rank == 0 ? grid_bin_detect(input_filename) : 0;
+    MPI_Bcast(&binary, 1, MPI_INT, 0, decomp.comm);
+    bool want_png = strcmp(image_filename, "-") != 0;
+    bool need_full = !binary || want_png;
 
-                if (distribute > 0)
-                {
-                    local_changed = true;
+    grid_t full_grid;
+    if (rank == 0 && need_full && grid_alloc(&full_grid, N, M) != 0)
+    {
+        fprintf(stderr, "Grid allocation failed\n");
+        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    }
 
-                    // Distribute to neighbors
-                    local_next[i - 1][j] += distribute; // up (might be ghost)
-                    local_next[i + 1][j] += distribute; // down (might be ghost)
+    // --restart: every rank reads its block of the last checkpoint, whatever
+    // the rank count that wrote it; the output still follows the input
+    checkpoint_t checkpoint;
+    checkpoint_init(&checkpoint, argc, argv);
+    const char *source_filename = checkpoint.restart ? checkpoint.path : input_filename;
 
-                    if (j > 0)
-                        local_next[i][j - 1] += distribute; // left
-                    if (j < M - 1)
-                        local_next[i][j + 1] += distribute; // right
-                }
-            }
+    grid_bin_header_t header = {N, M, 4, 0};
+    if (binary || checkpoint.restart)
+    {
+        if (decomp_read_bin(&decomp, source_filename, &local_grid, &header) != 0)
+        {
+            if (rank == 0)
+                fprintf(stderr, "Failed to read %d x %d binary grid from %s\n", N, M, source_filename);
+            MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
         }
-
-        // Handle boundary contributions from ghost cells
-        // Top ghost row contributions
-        if (prev_rank != MPI_PROC_NULL)
+    }
+    else
+    {
+        // Read the initial grid on rank 0
+        if (rank == 0)
         {
-            for (int j = 0; j < M; j++)
+            FILE *input = fopen(input_filename, "r");
+            if (!input)
+            {
+                perror("fopen input");
+                MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+            }
+            if (grid_read_text(&full_grid, input) != 0)
             {
-                int grains = local_grid[0][j];
-                int distribute = grains / 4;
-                if (distribute > 0)
-                    local_next[1][j] += distribute;
+                fprintf(stderr, "Failed to read %d x %d grid from %s\n", N, M, input_filename);
+                MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
             }
+            fclose(input);
         }
 
-        // Bottom ghost row contributions
-        if (next_rank != MPI_PROC_NULL)
+        // Send every rank its block straight from the full grid into the local interior
+        decomp_scatter(&decomp, &full_grid, &local_grid);
+    }
+
+    // --active: sweep only local tiles that are unstable or next to unstable ones
+    active_set_t active;
+    if (use_active && active_init(&active, &local_grid, ACTIVE_TILE_ROWS, ACTIVE_TILE_COLS) != 0)
+    {
+        fprintf(stderr, "Rank %d: active set allocation failed\n", rank);
+        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    }
+
+    // --trace=path: per-iteration timeline of every rank, gathered on rank 0
+    // (make TRACE=1 builds only)
+    const char *trace_path = trace_option(argc, argv);
+
+    MPI_Barrier(decomp.comm); // Ensure all processes are synchronized before starting
+    trace_init(&trace, rank, trace_path != NULL);
+    // Start mpi timing
+    double start_time = MPI_Wtime();
+    checkpoint_mark(&checkpoint, 0, start_time);
+
+    // --async-convergence: overlap the convergence reduction with the next step
+    convergence_t convergence;
+    convergence_init(&convergence, decomp.comm, opt_flag(argc, argv, "async-convergence"));
+    bool stable = false;
+    long sweeps = 0;
+    long local_topples = 0;
+    long balanced = 0;  // sweep count at the last rebalance
+    double busy = 0.0;  // sweep time since then, halo waits excluded
+
+    while (!stable)
+    {
+        TRACE(trace_begin(&trace, sweeps));
+        TRACE(trace_scan(&trace, &local_grid, decomp.row0, decomp.col0));
+        double sweep_start = MPI_Wtime(), waited = halo_wait;
+
+        long topples;
+        bool local_changed;
+        if (depth > 1)
+        {
+            long last;
+            topples = sweep_deep_halo(&decomp, &local_grid, &local_next, depth, &last);
+            sweeps += depth;
+
+            // A block whose final sweep toppled nothing anywhere ended stable
+            local_changed = last > 0;
+        }
+        else
         {
-            for (int j = 0; j < M; j++)
+            // Exchange ghost rows and columns
+            MPI_Request requests[8];
+            int req_count = decomp_exchange_begin(&decomp, &local_grid, requests);
+
+            // Gather sweep over the local block; ghost cells supply the neighbours'
+            // spill and stay zero along the global edges
+            if (use_active)
             {
-                int grains = local_grid[local_rows + 1][j];
-                int distribute = grains / 4;
-                if (distribute > 0)
-                    local_next[local_rows][j] += distribute;
+                wait_halo(req_count, requests);
+
+                // Unstable ghost cells wake the tiles along that edge
+                if (decomp.up != MPI_PROC_NULL)
+                    active_scan_ghost(&active, &local_grid, -1);
+                if (decomp.down != MPI_PROC_NULL)
+                    active_scan_ghost(&active, &local_grid, decomp.rows);
+                if (decomp.left != MPI_PROC_NULL)
+                    active_scan_ghost_col(&active, &local_grid, -1);
+                if (decomp.right != MPI_PROC_NULL)
+                    active_scan_ghost_col(&active, &local_grid, decomp.cols);
+                topples = active_sweep(&active, &local_grid, &local_next);
             }
-        }
+            else
+            {
+                // Cells away from the exchanged edges never read a ghost cell, so
+                // they are swept while the halos are in flight
+                topples = sweep_inner(&decomp, &local_grid, &local_next);
+                wait_halo(req_count, requests);
+                topples += sweep_edges(&decomp, &local_grid, &local_next);
+            }
+            local_changed = topples > 0;
 
-        // Swap grids
-        int **tmp = local_grid;
-        local_grid = local_next;
-        local_next = tmp;
+            // Swap grids
+            grid_swap(&local_grid, &local_next);
+            sweeps++;
+        }
+        local_topples += topples;
+        busy += MPI_Wtime() - sweep_start - (halo_wait - waited);
 
         // Global reduction to check if any process had changes
-        MPI_Allreduce(&local_changed, &global_changed, 1, MPI_C_BOOL, MPI_LOR, MPI_COMM_WORLD);
+        bool write = checkpoint_due(&checkpoint, sweeps, MPI_Wtime());
+        TRACE(trace_wait_begin(&trace, TRACE_REDUCE));
+        stable = convergence_step(&convergence, local_changed, &write);
+        TRACE(trace_wait_end(&trace, TRACE_REDUCE));
+        TRACE(trace_end(&trace, topples));
+        if (write && !stable)
+            write_checkpoint(&decomp, &checkpoint, &local_grid, header.iteration + sweeps, sweeps);
+
+        if (rebalance > 0 && !stable && sweeps - balanced >= rebalance)
+        {
+            if (rebalance_slabs(&decomp, busy, depth, &local_grid, &local_next) && use_active)
+            {
+                active_free(&active);
+                if (active_init(&active, &local_grid, ACTIVE_TILE_ROWS, ACTIVE_TILE_COLS) != 0)
+                {
+                    fprintf(stderr, "Rank %d: active set allocation failed\n", rank);
+                    MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+                }
+            }
+            busy = 0.0;
+            balanced = sweeps;
+        }
     }
 
     // End mpi timing
@@ -296,64 +728,75 @@ int main(int argc, char *argv[])
 
     if (rank == 0)
     {
+#ifdef _OPENMP
+        printf("MPI time (%d processes x %d threads): %f seconds\n", size, omp_get_max_threads(),
+               end_time - start_time);
+#else
         printf("MPI time (%d processes): %f seconds\n", size, end_time - start_time);
+#endif
     }
 
-    // Gather final results
-    for (int i = 0; i < local_rows; i++)
-        for (int j = 0; j < M; j++)
-            recvbuf[i * M + j] = local_grid[i + 1][j];
+    // --stats: one JSON line in the schema shared with the other drivers
+    if (opt_flag(argc, argv, "stats"))
+    {
+        long topples;
+        MPI_Reduce(&local_topples, &topples, 1, MPI_LONG, MPI_SUM, 0, decomp.comm);
+#ifdef _OPENMP
+        int threads = omp_get_max_threads();
+#else
+        int threads = 1;
+#endif
+        run_stats_t stats = {"mpi", N, M, size, threads, sweeps, topples, end_time - start_time, 0, true};
+        if (rank == 0)
+            stats_print(&stats, stdout);
+    }
 
-    MPI_Gatherv(recvbuf, local_rows * M, MPI_INT, sendbuf, sendcounts, displs, MPI_INT, 0, MPI_COMM_WORLD);
+    if (trace_path)
+        write_traces(&decomp, &trace, trace_path);
+    trace_free(&trace);
 
-    // Write output (rank 0 only)
-    if (rank == 0)
+    char *output_filename = generate_output_filename(input_filename);
+    if (binary && decomp_write_bin(&decomp, output_filename, &local_grid, 1, header.iteration + sweeps) != 0)
     {
-        // Reconstruct full grid
-        for (int i = 0; i < N; i++)
-            for (int j = 0; j < M; j++)
-                full_grid[i][j] = sendbuf[i * M + j];
+        fprintf(stderr, "Rank %d: failed to write %s\n", rank, output_filename);
+        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    }
 
-        char *output_filename = generate_output_filename(input_filename);
-        FILE *output = fopen(output_filename, "w");
-        if (!output)
-        {
-            perror("fopen output");
-            MPI_Finalize();
-            return EXIT_FAILURE;
-        }
+    // Gather final results straight into the full grid
+    if (need_full)
+        decomp_gather(&decomp, &local_grid, &full_grid);
 
-        for (int i = 0; i < N; i++)
+    // Write output (rank 0 only)
+    if (rank == 0 && need_full)
+    {
+        if (!binary)
         {
-            for (int j = 0; j < M; j++)
+            FILE *output = fopen(output_filename, "w");
+            if (!output)
             {
-                fprintf(output, "%d%s", full_grid[i][j], j == M - 1 ? "" : " ");
+                perror("fopen output");
+                MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
             }
-            fprintf(output, "\n");
+
+            grid_write_text(&full_grid, output);
+            fclose(output);
         }
-        fclose(output);
 
-        write_png(image_filename, full_grid, N, M);
+        if (want_png)
+            write_png(image_filename, &full_grid, N, M);
 
         // Cleanup
-        for (int i = 0; i < N; i++)
-            free(full_grid[i]);
-        free(full_grid);
-        free(output_filename);
-        free(sendbuf);
+        grid_free(&full_grid);
     }
+    free(output_filename);
 
     // Cleanup local data
-    for (int i = 0; i < local_rows + 2; i++)
-    {
-        free(local_grid[i]);
-        free(local_next[i]);
-    }
-    free(local_grid);
-    free(local_next);
-    free(recvbuf);
-    free(sendcounts);
-    free(displs);
+    grid_free(&local_grid);
+    grid_free(&local_next);
+    if (use_active)
+        active_free(&active);
+    decomp_free(&decomp);
+    checkpoint_free(&checkpoint);
 
     MPI_Finalize();
     return EXIT_SUCCESS;
@@ -0,0 +1,270 @@
+// sched_yield under -std=c11
+#define _POSIX_C_SOURCE 200809L
+
+#include "omp_async.h"
+#include "kernel.h"
+
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define cpu_relax() _mm_pause()
+#else
+#define cpu_relax() __asm__ __volatile__("" ::: "memory")
+#endif
+
+// Idle rounds that spin (2^round pauses each) before an idle thread starts
+// yielding its time slice instead
+#define SPIN_ROUNDS 10
+
+enum
+{
+    FROM_ABOVE,
+    FROM_BELOW
+};
+
+typedef struct
+{
+    int row0;           // first global row of the band
+    grid_t cells;       // private copy; top and bottom border rows collect outgoing grains
+    int *inbox[2];      // grains posted by the band above / below, not yet taken in
+    int full[2];        // inbox holds grains
+    omp_lock_t lock[2];
+} band_t;
+
+// Busy threads plus non-empty mailboxes; zero means the grid is stable
+static long pending;
+
+// Adds the strip of grains leaving a band to its neighbour's inbox and clears it
+static void post(band_t *to, int side, cell_t *strip, int cols)
+{
+    int any = 0;
+    for (int j = 0; j < cols && !any; j++)
+        any = strip[j] != 0;
+    if (!any)
+        return;
+
+    omp_set_lock(&to->lock[side]);
+    int *box = to->inbox[side];
+    for (int j = 0; j < cols; j++)
+        box[j] += strip[j];
+    if (!to->full[side])
+    {
+        // Counted before this thread can go idle, so pending never drops to
+        // zero while the grains are in transit
+        #pragma omp atomic
+        pending++;
+        #pragma omp atomic write
+        to->full[side] = 1;
+    }
+    omp_unset_lock(&to->lock[side]);
+    memset(strip, 0, (size_t)cols * sizeof(cell_t));
+}
+
+// Moves the grains of one inbox into the edge row. Narrow cells take only what
+// keeps them at CELL_SAFE; the rest waits for the next drain. Returns 1 if
+// anything was taken.
+static int drain(band_t *b, int side)
+{
+    int full;
+    #pragma omp atomic read
+    full = b->full[side];
+    if (!full)
+        return 0;
+
+    omp_set_lock(&b->lock[side]);
+    int *box = b->inbox[side];
+    cell_t *edge = grid_row(&b->cells, side == FROM_ABOVE ? 0 : b->cells.rows - 1);
+    int left = 0;
+    for (int j = 0; j < b->cells.cols; j++)
+    {
+        int take = box[j];
+        if (take > CELL_SAFE - edge[j])
+            take = edge[j] < CELL_SAFE ? CELL_SAFE - edge[j] : 0;
+        edge[j] += (cell_t)take;
+        box[j] -= take;
+        left |= box[j];
+    }
+    if (!left)
+    {
+        #pragma omp atomic write
+        b->full[side] = 0;
+        #pragma omp atomic
+        pending--;
+    }
+    omp_unset_lock(&b->lock[side]);
+    return 1;
+}
+
+// One wait of an idle thread: pauses, doubling each round, which keep a
+// hyperthread sibling's pipeline free, then sched_yield once the wait has
+// gone on long enough that the core is likely wanted by another thread
+static void back_off(int *round)
+{
+    if (*round < SPIN_ROUNDS)
+    {
+        for (int k = 0; k < 1 << *round; k++)
+            cpu_relax();
+        ++*round;
+    }
+    else
+        sched_yield();
+}
+
+// Grains leaving through the left and right edges fall into the sink. With
+// narrow cells relaxing stops early once an outgoing strip passes CELL_SAFE.
+static int strips_full(grid_t *g)
+{
+    for (int i = 0; i < g->rows; i++)
+    {
+        GRID_AT(g, i, -1) = 0;
+        GRID_AT(g, i, g->cols) = 0;
+    }
+    if (CELL_BITS == 32)
+        return 0;
+    const cell_t *top = grid_row(g, -1), *bottom = grid_row(g, g->rows);
+    for (int j = 0; j < g->cols; j++)
+        if (top[j] > CELL_SAFE || bottom[j] > CELL_SAFE)
+            return 1;
+    return 0;
+}
+
+long omp_async_stabilize(grid_t *grid, long *sweeps, trace_t *traces)
+{
+    int N = grid->rows, M = grid->cols;
+    band_t *bands = NULL;
+    int nbands = 1;
+    int failed = 0;
+    long total = 0, rounds = 0;
+
+    #pragma omp parallel reduction(+:total) reduction(max:rounds)
+    {
+        int t = omp_get_thread_num();
+
+        #pragma omp single
+        {
+            nbands = omp_get_num_threads() < N ? omp_get_num_threads() : N;
+            bands = calloc(nbands, sizeof *bands);
+            if (!bands)
+                failed = 1;
+            pending = nbands;
+        }
+
+        // Allocated and filled by the owning thread so its pages are local
+        band_t *own = !failed && t < nbands ? &bands[t] : NULL;
+        if (own)
+        {
+            int r0 = (int)((long)t * N / nbands), r1 = (int)((long)(t + 1) * N / nbands);
+            own->row0 = r0;
+            own->inbox[FROM_ABOVE] = calloc(M, sizeof(int));
+            own->inbox[FROM_BELOW] = calloc(M, sizeof(int));
+            omp_init_lock(&own->lock[FROM_ABOVE]);
+            omp_init_lock(&own->lock[FROM_BELOW]);
+            if (grid_alloc(&own->cells, r1 - r0, M) != 0 || !own->inbox[FROM_ABOVE] || !own->inbox[FROM_BELOW])
+            {
+                #pragma omp atomic write
+                failed = 1;
+            }
+            else
+            {
+                for (int i = 0; i < r1 - r0; i++)
+                    memcpy(grid_row(&own->cells, i), grid_row(grid, r0 + i), (size_t)M * sizeof(cell_t));
+            }
+        }
+        // The only barrier: every inbox must exist before the first post
+        #pragma omp barrier
+
+        TRACE(trace_t *trace = traces ? &traces[t] : NULL);
+        long own_rounds = 0;
+        while (own && !failed)
+        {
+            TRACE(if (trace) trace_begin(trace, own_rounds));
+            TRACE(if (trace) trace_scan(trace, &own->cells, own->row0, 0));
+            long pass, round = 0;
+            do
+            {
+                pass = sandpile_relax(&own->cells, 0, own->cells.rows, 0, M);
+                round += pass;
+            } while (pass > 0 && !strips_full(&own->cells));
+            total += round;
+            own_rounds++;
+
+            cell_t *top = grid_row(&own->cells, -1), *bottom = grid_row(&own->cells, own->cells.rows);
+            if (t > 0)
+                post(&bands[t - 1], FROM_BELOW, top, M);
+            else
+                memset(top, 0, (size_t)M * sizeof(cell_t));
+            if (t < nbands - 1)
+                post(&bands[t + 1], FROM_ABOVE, bottom, M);
+            else
+                memset(bottom, 0, (size_t)M * sizeof(cell_t));
+
+            int taken = drain(own, FROM_ABOVE) | drain(own, FROM_BELOW);
+            if (taken || pass > 0)
+            {
+                TRACE(if (trace) trace_end(trace, round));
+                continue;
+            }
+
+            // Locally stable with empty inboxes: idle until grains arrive or
+            // every band is done
+            #pragma omp atomic
+            pending--;
+            TRACE(if (trace) trace_wait_begin(trace, TRACE_HALO));
+            int woken = 0, spins = 0;
+            for (;;)
+            {
+                int above, below;
+                long left;
+                #pragma omp atomic read
+                above = own->full[FROM_ABOVE];
+                #pragma omp atomic read
+                below = own->full[FROM_BELOW];
+                if (above || below)
+                {
+                    #pragma omp atomic
+                    pending++;
+                    woken = 1;
+                    break;
+                }
+                #pragma omp atomic read
+                left = pending;
+                if (left == 0)
+                    break;
+                back_off(&spins);
+            }
+            TRACE(if (trace) trace_wait_end(trace, TRACE_HALO));
+            TRACE(if (trace) trace_end(trace, round));
+            if (!woken)
+                break;
+            drain(own, FROM_ABOVE);
+            drain(own, FROM_BELOW);
+        }
+
+        rounds = own_rounds;
+        #pragma omp barrier
+        if (own)
+        {
+            if (!failed)
+                for (int i = 0; i < own->cells.rows; i++)
+                    memcpy(grid_row(grid, own->row0 + i), grid_row(&own->cells, i), (size_t)M * sizeof(cell_t));
+            grid_free(&own->cells);
+            free(own->inbox[FROM_ABOVE]);
+            free(own->inbox[FROM_BELOW]);
+            omp_destroy_lock(&own->lock[FROM_ABOVE]);
+            omp_destroy_lock(&own->lock[FROM_BELOW]);
+        }
+    }
+
+    free(bands);
+    if (failed)
+    {
+        fprintf(stderr, "Band allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    *sweeps = rounds;
+    return total;
+}
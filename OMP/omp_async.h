@@ -0,0 +1,29 @@
+/*
+ * Asynchronous in-place OpenMP engine.
+ *
+ * Every thread owns a band of whole rows in a private bordered buffer and
+ * relaxes it in place (Gauss-Seidel) until it is locally stable. Grains that
+ * leave the band collect in the buffer's top and bottom border rows and are
+ * then posted to the neighbouring band's mailbox, a lock-protected row of
+ * pending grains. A thread drains its own two mailboxes into its edge rows
+ * whenever it finishes relaxing, so threads only ever wait on the lock of an
+ * edge they share and never on a barrier. The run ends when no thread is busy
+ * and every mailbox is empty, which a single counter of busy threads plus
+ * non-empty mailboxes detects: work only moves between the two after the
+ * receiving side has been counted.
+ */
+
+#ifndef SANDPILE_OMP_ASYNC_H
+#define SANDPILE_OMP_ASYNC_H
+
+#include "grid.h"
+#include "trace.h"
+
+// Stabilizes grid in place with the current OpenMP thread count. Returns the
+// number of topples; *sweeps receives the largest number of relax-and-post
+// rounds any thread went through. traces holds one trace per thread
+// (omp_get_max_threads of them), or is NULL; a round's idle wait for grains
+// from the neighbouring bands is recorded as its halo wait.
+long omp_async_stabilize(grid_t *grid, long *sweeps, trace_t *traces);
+
+#endif
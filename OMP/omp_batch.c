@@ -0,0 +1,296 @@
+// strdup under -std=c11
+#define _POSIX_C_SOURCE 200809L
+
+#include "omp_batch.h"
+#include "omp_tiled.h"
+#include "grid.h"
+#include "grid_bin.h"
+#include "kernel.h"
+#include "stats.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+
+#define MANIFEST_LINE 4096
+
+typedef struct
+{
+    int rows, cols;
+    char *input, *output;       // manifest jobs: one file each way
+    long in_offset, out_offset; // binary jobs: record positions in the batch files
+    int failed;
+    run_stats_t stats;
+} batch_job_t;
+
+typedef struct
+{
+    batch_job_t *jobs;
+    int count, capacity;
+    bool binary;
+    const char *source, *output;
+} batch_t;
+
+static batch_job_t *add_job(batch_t *b)
+{
+    if (b->count == b->capacity)
+    {
+        int capacity = b->capacity ? 2 * b->capacity : 64;
+        batch_job_t *jobs = realloc(b->jobs, (size_t)capacity * sizeof *jobs);
+        if (!jobs)
+            return NULL;
+        b->jobs = jobs;
+        b->capacity = capacity;
+    }
+    batch_job_t *job = &b->jobs[b->count++];
+    memset(job, 0, sizeof *job);
+    return job;
+}
+
+static int read_manifest(batch_t *b, FILE *input)
+{
+    char line[MANIFEST_LINE], in[MANIFEST_LINE], out[MANIFEST_LINE];
+    for (int number = 1; fgets(line, sizeof line, input); number++)
+    {
+        char *p = line + strspn(line, " \t");
+        if (*p == '#' || *p == '\n' || *p == '\0')
+            continue;
+        int rows, cols;
+        if (sscanf(p, "%d %d %s %s", &rows, &cols, in, out) != 4 || rows <= 0 || cols <= 0)
+        {
+            fprintf(stderr, "%s:%d: expected N M input output\n", b->source, number);
+            return -1;
+        }
+        batch_job_t *job = add_job(b);
+        if (!job || !(job->input = strdup(in)) || !(job->output = strdup(out)))
+            return -1;
+        job->rows = rows;
+        job->cols = cols;
+    }
+    return 0;
+}
+
+// Indexes the records of a multi-grid binary file and lays out the output,
+// where every stable grid takes a header and one byte per cell
+static int read_records(batch_t *b, FILE *input)
+{
+    long out_offset = 0;
+    grid_bin_header_t header;
+    while (grid_bin_read_header(input, &header) == 0)
+    {
+        long offset = ftell(input) - GRID_BIN_HEADER_BYTES;
+        long cells = (long)header.rows * header.cols;
+        batch_job_t *job = add_job(b);
+        if (!job || fseek(input, cells * header.cell_bytes, SEEK_CUR) != 0)
+            return -1;
+        job->rows = header.rows;
+        job->cols = header.cols;
+        job->in_offset = offset;
+        job->out_offset = out_offset;
+        out_offset += GRID_BIN_HEADER_BYTES + cells;
+    }
+    if (!feof(input) && fgetc(input) != EOF)
+    {
+        fprintf(stderr, "%s: record %d is not a binary grid\n", b->source, b->count + 1);
+        return -1;
+    }
+    return 0;
+}
+
+// Points g at a rows x cols buffer, keeping the previous one if it has that
+// size. The sweep never writes the border, so a reused buffer's stays zero.
+static int reuse_grid(grid_t *g, int rows, int cols)
+{
+    if (g->data && g->rows == rows && g->cols == cols)
+        return 0;
+    grid_free(g);
+    return grid_alloc(g, rows, cols);
+}
+
+static int load(const batch_t *b, const batch_job_t *job, grid_t *g, FILE *records, uint64_t *iteration)
+{
+    grid_bin_header_t header = {job->rows, job->cols, 4, 0};
+    int status;
+    if (b->binary)
+    {
+        status = fseek(records, job->in_offset, SEEK_SET) == 0 && grid_bin_read_header(records, &header) == 0
+                     ? grid_bin_read_cells(g, records, &header)
+                     : -1;
+    }
+    else
+    {
+        int binary = grid_bin_detect(job->input);
+        FILE *input = fopen(job->input, binary ? "rb" : "r");
+        if (!input)
+            return -1;
+        status = binary ? grid_bin_read_header(input, &header) : 0;
+        if (status == 0)
+            status = binary ? grid_bin_read_cells(g, input, &header) : grid_read_text(g, input);
+        fclose(input);
+    }
+    *iteration = header.iteration;
+    return status;
+}
+
+// Same output rules as a single run: binary inputs give binary outputs
+static int store(const batch_t *b, const batch_job_t *job, const grid_t *g, FILE *results, uint64_t iteration)
+{
+    if (b->binary)
+        return fseek(results, job->out_offset, SEEK_SET) == 0 ? grid_bin_write(g, results, 1, iteration) : -1;
+
+    int binary = grid_bin_detect(job->input);
+    FILE *output = fopen(job->output, binary ? "wb" : "w");
+    if (!output)
+        return -1;
+    int status = 0;
+    if (binary)
+        status = grid_bin_write(g, output, 1, iteration);
+    else
+        grid_write_text(g, output);
+    return fclose(output) == 0 ? status : -1;
+}
+
+// Serial Jacobi loop; the result ends up in *cur
+static long stabilize(grid_t *cur, grid_t *next, long *sweeps)
+{
+    long topples = 0, pass;
+    *sweeps = 0;
+    do
+    {
+        pass = sandpile_sweep(cur, next, 0, cur->rows, 0, cur->cols, NULL);
+        topples += pass;
+        grid_swap(cur, next);
+        (*sweeps)++;
+    } while (pass > 0);
+    return topples;
+}
+
+static bool shared(const batch_job_t *job)
+{
+    return (long)job->rows * job->cols >= BATCH_SHARED_CELLS;
+}
+
+int omp_batch_run(const char *source, const char *output, bool stats)
+{
+    batch_t b = {NULL, 0, 0, grid_bin_detect(source) == 1, source, output};
+    FILE *input = fopen(source, b.binary ? "rb" : "r");
+    if (!input)
+    {
+        perror("fopen batch");
+        return -1;
+    }
+    int status = b.binary ? read_records(&b, input) : read_manifest(&b, input);
+    fclose(input);
+    if (status == 0 && b.binary)
+    {
+        // Created here, then written at fixed offsets through one handle per thread
+        FILE *results = output ? fopen(output, "wb") : NULL;
+        if (!results || fclose(results) != 0)
+        {
+            fprintf(stderr, "Cannot create batch output %s\n", output ? output : "(none, pass --batch-output)");
+            status = -1;
+        }
+    }
+    if (status != 0)
+    {
+        for (int k = 0; k < b.count; k++)
+        {
+            free(b.jobs[k].input);
+            free(b.jobs[k].output);
+        }
+        free(b.jobs);
+        return -1;
+    }
+
+    sandpile_kernel_init();
+    double start_time = omp_get_wtime();
+
+    // Small grids: one per thread, handed out as threads become free
+    #pragma omp parallel
+    {
+        grid_t cur = {0}, next = {0};
+        FILE *records = b.binary ? fopen(source, "rb") : NULL;
+        FILE *results = b.binary ? fopen(output, "r+b") : NULL;
+        bool files = !b.binary || (records && results);
+
+        #pragma omp for schedule(dynamic, 1)
+        for (int k = 0; k < b.count; k++)
+        {
+            batch_job_t *job = &b.jobs[k];
+            if (shared(job))
+                continue;
+            uint64_t iteration;
+            if (!files || reuse_grid(&cur, job->rows, job->cols) != 0 || reuse_grid(&next, job->rows, job->cols) != 0 ||
+                load(&b, job, &cur, records, &iteration) != 0)
+            {
+                job->failed = 1;
+                continue;
+            }
+            double t0 = omp_get_wtime();
+            long sweeps;
+            long topples = stabilize(&cur, &next, &sweeps);
+            job->stats = (run_stats_t){"omp-batch", job->rows, job->cols, 1, 1, sweeps, topples, omp_get_wtime() - t0, 0, true};
+            job->failed = store(&b, job, &cur, results, iteration + sweeps) != 0;
+        }
+
+        grid_free(&cur);
+        grid_free(&next);
+        if (records)
+            fclose(records);
+        if (results && fclose(results) != 0)
+        {
+            #pragma omp critical
+            status = -1;
+        }
+    }
+
+    // Large grids: the whole team on each in turn
+    FILE *records = b.binary ? fopen(source, "rb") : NULL;
+    FILE *results = b.binary ? fopen(output, "r+b") : NULL;
+    grid_t grid = {0};
+    for (int k = 0; k < b.count; k++)
+    {
+        batch_job_t *job = &b.jobs[k];
+        if (!shared(job))
+            continue;
+        uint64_t iteration;
+        if ((b.binary && (!records || !results)) || reuse_grid(&grid, job->rows, job->cols) != 0 ||
+            load(&b, job, &grid, records, &iteration) != 0)
+        {
+            job->failed = 1;
+            continue;
+        }
+        double t0 = omp_get_wtime();
+        long sweeps;
+        long topples = omp_tiled_stabilize(&grid, &sweeps, NULL);
+        job->stats = (run_stats_t){"omp-batch", job->rows, job->cols, 1, omp_get_max_threads(), sweeps, topples,
+                                   omp_get_wtime() - t0, 0, false};
+        job->failed = store(&b, job, &grid, results, iteration + sweeps) != 0;
+    }
+    grid_free(&grid);
+    if (records)
+        fclose(records);
+    if (results && fclose(results) != 0)
+        status = -1;
+
+    double seconds = omp_get_wtime() - start_time;
+    int failed = 0;
+    for (int k = 0; k < b.count; k++)
+    {
+        batch_job_t *job = &b.jobs[k];
+        if (job->failed)
+            fprintf(stderr, "Batch grid %d (%s) failed\n", k + 1, b.binary ? source : job->input);
+        failed += job->failed;
+        if (stats && !job->failed)
+            stats_print(&job->stats, stdout);
+        free(job->input);
+        free(job->output);
+    }
+    printf("Batch: %d grids in %f seconds (%.1f grids/s), %d failed\n", b.count, seconds,
+           seconds > 0 ? b.count / seconds : 0.0, failed);
+    free(b.jobs);
+    if (status != 0 && failed == 0)
+        failed = b.count;
+    return failed;
+}
@@ -0,0 +1,29 @@
+/*
+ * Batch mode: stabilize many grids in one process.
+ *
+ * The grids come either from a manifest, one "N M input output" line per
+ * grid (blank lines and lines starting with # are skipped), or from a
+ * multi-grid binary file, i.e. .spg records (grid_bin.h) written back to back,
+ * whose stable results are written back to back in the same order to another
+ * file. Grids below BATCH_SHARED_CELLS cells are stabilized concurrently, one
+ * per thread with the serial Jacobi kernel, in buffers each thread keeps and
+ * reuses while consecutive grids have the same size. Larger grids are then run
+ * one after another by the whole team with the tiled engine.
+ */
+
+#ifndef SANDPILE_OMP_BATCH_H
+#define SANDPILE_OMP_BATCH_H
+
+#include <stdbool.h>
+
+// Grids with at least this many cells are shared by all threads
+#define BATCH_SHARED_CELLS (512L * 512L)
+
+// Runs the batch described by source (manifest or multi-grid .spg). output
+// names the result file for a binary source and is ignored for a manifest.
+// With stats a --stats line is printed for every grid. Returns the number of
+// grids that could not be read, stabilized or written, or -1 if the batch
+// itself could not be set up.
+int omp_batch_run(const char *source, const char *output, bool stats);
+
+#endif
@@ -0,0 +1,285 @@
+#include "omp_tasks.h"
+#include "kernel.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+
+// Edges of a tile, also the inbox sides grains arrive on
+enum
+{
+    EDGE_TOP,
+    EDGE_BOTTOM,
+    EDGE_LEFT,
+    EDGE_RIGHT
+};
+
+// Inbox cells per tile: the top and bottom rows, then the left and right columns
+#define INBOX_CELLS (2 * TASK_TILE_COLS + 2 * TASK_TILE_ROWS)
+
+typedef struct
+{
+    grid_t *grid;
+    int rows, cols;     // tiles per dimension
+    omp_lock_t *owner;  // held by the task running the tile
+    omp_lock_t *box;    // guards the tile's inbox
+    int *inbox;         // INBOX_CELLS grains per tile posted by its neighbours
+    int *queued;
+    long topples, tasks;
+} scheduler_t;
+
+// Per-thread buffer a task relaxes its tile in, and the grains it pushed out
+typedef struct
+{
+    grid_t cells;
+    int *out;           // INBOX_CELLS, laid out like an inbox
+} scratch_t;
+
+static scratch_t *scratches;
+
+static void tile_bounds(const scheduler_t *s, int k, int *r0, int *r1, int *c0, int *c1)
+{
+    int a = k / s->cols, b = k % s->cols;
+    *r0 = a * TASK_TILE_ROWS;
+    *c0 = b * TASK_TILE_COLS;
+    *r1 = *r0 + TASK_TILE_ROWS < s->grid->rows ? *r0 + TASK_TILE_ROWS : s->grid->rows;
+    *c1 = *c0 + TASK_TILE_COLS < s->grid->cols ? *c0 + TASK_TILE_COLS : s->grid->cols;
+}
+
+static int *edge_of(int *cells, int side)
+{
+    static const int offset[] = {0, TASK_TILE_COLS, 2 * TASK_TILE_COLS, 2 * TASK_TILE_COLS + TASK_TILE_ROWS};
+    return cells + offset[side];
+}
+
+// Whether a rectangle holds a cell that must topple
+static int unstable(const grid_t *g, int r0, int r1, int c0, int c1)
+{
+    for (int i = r0; i < r1; i++)
+    {
+        const cell_t *row = grid_row(g, i);
+        for (int j = c0; j < c1; j++)
+            if (row[j] > 3)
+                return 1;
+    }
+    return 0;
+}
+
+static void run_tile(scheduler_t *s, int k);
+
+// Queues tile k unless it is already waiting for its task
+static void enqueue(scheduler_t *s, int k)
+{
+    int was;
+    #pragma omp atomic capture
+    {
+        was = s->queued[k];
+        s->queued[k] = 1;
+    }
+    if (!was)
+    {
+        #pragma omp task firstprivate(k)
+        run_tile(s, k);
+    }
+}
+
+// Adds one cell's share of an inbox to it. Narrow cells take only what keeps
+// them at CELL_SAFE; the rest stays in the inbox. Returns the grains left.
+static int take(cell_t *cell, int *box)
+{
+    int grains = *box;
+    if (grains > CELL_SAFE - *cell)
+        grains = *cell < CELL_SAFE ? CELL_SAFE - *cell : 0;
+    *cell += (cell_t)grains;
+    *box -= grains;
+    return *box;
+}
+
+// Moves tile k's inbox into the edges of view, its h x w copy. Returns 1 if
+// grains were left behind.
+static int drain(scheduler_t *s, int k, grid_t *view)
+{
+    int h = view->rows, w = view->cols, left = 0;
+    int *box = s->inbox + (size_t)k * INBOX_CELLS;
+    omp_set_lock(&s->box[k]);
+    for (int j = 0; j < w; j++)
+    {
+        left |= take(&GRID_AT(view, 0, j), &edge_of(box, EDGE_TOP)[j]);
+        left |= take(&GRID_AT(view, h - 1, j), &edge_of(box, EDGE_BOTTOM)[j]);
+    }
+    for (int i = 0; i < h; i++)
+    {
+        left |= take(&GRID_AT(view, i, 0), &edge_of(box, EDGE_LEFT)[i]);
+        left |= take(&GRID_AT(view, i, w - 1), &edge_of(box, EDGE_RIGHT)[i]);
+    }
+    omp_unset_lock(&s->box[k]);
+    return left != 0;
+}
+
+// Moves the border of view, the grains relaxing pushed out of the tile, into
+// the wide out strips and clears it, so the border never builds up
+static void collect(grid_t *view, int *out)
+{
+    int h = view->rows, w = view->cols;
+    cell_t *top = grid_row(view, -1), *bottom = grid_row(view, h);
+    for (int j = 0; j < w; j++)
+    {
+        edge_of(out, EDGE_TOP)[j] += top[j];
+        edge_of(out, EDGE_BOTTOM)[j] += bottom[j];
+        top[j] = bottom[j] = 0;
+    }
+    for (int i = 0; i < h; i++)
+    {
+        edge_of(out, EDGE_LEFT)[i] += GRID_AT(view, i, -1);
+        edge_of(out, EDGE_RIGHT)[i] += GRID_AT(view, i, w);
+        GRID_AT(view, i, -1) = GRID_AT(view, i, w) = 0;
+    }
+}
+
+// Adds n out-strip cells to the side of tile k's inbox facing the sender and
+// clears them. Returns 1 if any grain was posted.
+static int post(scheduler_t *s, int k, int side, int *strip, int n)
+{
+    int any = 0;
+    for (int j = 0; j < n && !any; j++)
+        any = strip[j] != 0;
+    if (!any)
+        return 0;
+
+    int *box = edge_of(s->inbox + (size_t)k * INBOX_CELLS, side);
+    omp_set_lock(&s->box[k]);
+    for (int j = 0; j < n; j++)
+        box[j] += strip[j];
+    omp_unset_lock(&s->box[k]);
+    memset(strip, 0, (size_t)n * sizeof *strip);
+    return 1;
+}
+
+static void run_tile(scheduler_t *s, int k)
+{
+    grid_t *g = s->grid;
+    scratch_t *own = &scratches[omp_get_thread_num()];
+    int a = k / s->cols, b = k % s->cols;
+    int r0, r1, c0, c1;
+    tile_bounds(s, k, &r0, &r1, &c0, &c1);
+    int h = r1 - r0, w = c1 - c0;
+
+    omp_set_lock(&s->owner[k]);
+    // Cleared before the inbox is drained, so grains posted from now on queue
+    // the tile again
+    #pragma omp atomic write
+    s->queued[k] = 0;
+
+    // The tile's corner of the scratch buffer, bordered like a grid of its own
+    grid_t view = {h, w, 1, own->cells.stride, own->cells.data};
+    for (int i = 0; i < h; i++)
+    {
+        memcpy(grid_row(&view, i), grid_row(g, r0 + i) + c0, (size_t)w * sizeof(cell_t));
+        GRID_AT(&view, i, -1) = GRID_AT(&view, i, w) = 0;
+    }
+    memset(grid_row(&view, -1), 0, (size_t)w * sizeof(cell_t));
+    memset(grid_row(&view, h), 0, (size_t)w * sizeof(cell_t));
+    int again = drain(s, k, &view);
+
+    long topples = 0, pass;
+    do
+    {
+        pass = sandpile_relax(&view, 0, h, 0, w);
+        topples += pass;
+        collect(&view, own->out);
+    } while (pass > 0);
+
+    for (int i = 0; i < h; i++)
+        memcpy(grid_row(g, r0 + i) + c0, grid_row(&view, i), (size_t)w * sizeof(cell_t));
+    omp_unset_lock(&s->owner[k]);
+
+    // Grains pushed past the grid's edge belong to the sink
+    int wake[5], woken = 0;
+    if (a > 0 && post(s, k - s->cols, EDGE_BOTTOM, edge_of(own->out, EDGE_TOP), w))
+        wake[woken++] = k - s->cols;
+    if (a < s->rows - 1 && post(s, k + s->cols, EDGE_TOP, edge_of(own->out, EDGE_BOTTOM), w))
+        wake[woken++] = k + s->cols;
+    if (b > 0 && post(s, k - 1, EDGE_RIGHT, edge_of(own->out, EDGE_LEFT), h))
+        wake[woken++] = k - 1;
+    if (b < s->cols - 1 && post(s, k + 1, EDGE_LEFT, edge_of(own->out, EDGE_RIGHT), h))
+        wake[woken++] = k + 1;
+    memset(own->out, 0, INBOX_CELLS * sizeof *own->out);
+    if (again)
+        wake[woken++] = k;
+
+    #pragma omp atomic
+    s->topples += topples;
+    #pragma omp atomic
+    s->tasks++;
+    // Task creation is a scheduling point, so the scratch buffer is done with
+    for (int n = 0; n < woken; n++)
+        enqueue(s, wake[n]);
+}
+
+long omp_tasks_stabilize(grid_t *grid, long *tasks)
+{
+    scheduler_t s = {grid, (grid->rows + TASK_TILE_ROWS - 1) / TASK_TILE_ROWS,
+                     (grid->cols + TASK_TILE_COLS - 1) / TASK_TILE_COLS, NULL, NULL, NULL, NULL, 0, 0};
+    int ntiles = s.rows * s.cols;
+    int nthreads = omp_get_max_threads();
+    s.owner = malloc((size_t)ntiles * sizeof *s.owner);
+    s.box = malloc((size_t)ntiles * sizeof *s.box);
+    s.inbox = calloc((size_t)ntiles * INBOX_CELLS, sizeof *s.inbox);
+    s.queued = calloc((size_t)ntiles, sizeof *s.queued);
+    int *seeds = malloc((size_t)ntiles * sizeof *seeds);
+    scratches = calloc((size_t)nthreads, sizeof *scratches);
+    int failed = !s.owner || !s.box || !s.inbox || !s.queued || !seeds || !scratches;
+    for (int t = 0; t < nthreads && !failed; t++)
+    {
+        scratches[t].out = calloc(INBOX_CELLS, sizeof *scratches[t].out);
+        failed = grid_alloc(&scratches[t].cells, TASK_TILE_ROWS, TASK_TILE_COLS) != 0 || !scratches[t].out;
+    }
+    if (failed)
+    {
+        fprintf(stderr, "Tile allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int k = 0; k < ntiles; k++)
+    {
+        omp_init_lock(&s.owner[k]);
+        omp_init_lock(&s.box[k]);
+    }
+    sandpile_kernel_init();
+
+    // The unstable tiles are found before any task runs and touches the grid
+    #pragma omp parallel for schedule(static)
+    for (int k = 0; k < ntiles; k++)
+    {
+        int r0, r1, c0, c1;
+        tile_bounds(&s, k, &r0, &r1, &c0, &c1);
+        seeds[k] = unstable(grid, r0, r1, c0, c1);
+    }
+
+    // The barrier closing the single region waits for every task, including
+    // the ones queued by other tasks
+    #pragma omp parallel
+    #pragma omp single
+    for (int k = 0; k < ntiles; k++)
+        if (seeds[k])
+            enqueue(&s, k);
+
+    for (int k = 0; k < ntiles; k++)
+    {
+        omp_destroy_lock(&s.owner[k]);
+        omp_destroy_lock(&s.box[k]);
+    }
+    for (int t = 0; t < nthreads; t++)
+    {
+        grid_free(&scratches[t].cells);
+        free(scratches[t].out);
+    }
+    free(scratches);
+    free(seeds);
+    free(s.owner);
+    free(s.box);
+    free(s.inbox);
+    free(s.queued);
+    *tasks = s.tasks;
+    return s.topples;
+}
@@ -0,0 +1,35 @@
+/*
+ * Task-scheduled OpenMP engine over active tiles.
+ *
+ * The grid is cut into tiles and only tiles holding an unstable cell get work:
+ * one OpenMP task per such tile, which relaxes the tile (Gauss-Seidel) until
+ * it is stable. Grains it pushes over an edge can make the neighbouring tile
+ * unstable; that tile is then queued as a task of its own unless it is
+ * already waiting. The run ends when no task is left, so quiet regions cost
+ * nothing and there is no global changed flag or per-sweep barrier; idle
+ * threads take queued tasks from busy ones through the runtime's task
+ * scheduler.
+ *
+ * A task copies its tile into a private bordered buffer, relaxes it there and
+ * copies it back; a per-tile lock keeps two tasks off the same tile. Grains
+ * that leave the tile collect in the buffer's border and are posted to the
+ * neighbours' inboxes, lock-protected strips of wide counters along each
+ * tile edge, which a task drains into its edge cells before relaxing. Narrow
+ * cells take only what keeps them at CELL_SAFE and the tile queues itself
+ * again for the rest, so no tile ever stalls on a full neighbour.
+ */
+
+#ifndef SANDPILE_OMP_TASKS_H
+#define SANDPILE_OMP_TASKS_H
+
+#include "grid.h"
+
+#define TASK_TILE_ROWS 64
+#define TASK_TILE_COLS 128
+
+// Stabilizes grid in place with the current OpenMP thread count. Returns the
+// number of topples; *tasks receives the number of tile tasks run, which has
+// no fixed relation to sweeps and varies with the thread count.
+long omp_tasks_stabilize(grid_t *grid, long *tasks);
+
+#endif
@@ -0,0 +1,201 @@
+#include "omp_tiled.h"
+#include "kernel.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+
+typedef struct
+{
+    int row0, col0; // position of the tile in the global grid
+    grid_t cells;   // private copy; the border collects grains leaving the tile
+} tile_t;
+
+// Picks a tile_rows x tile_cols layout with at most `threads` tiles, using as
+// many threads as possible and keeping tiles close to square
+static void choose_layout(int threads, int N, int M, int *tile_rows, int *tile_cols)
+{
+    for (int tiles = threads; tiles > 1; tiles--)
+    {
+        double best = -1.0;
+        for (int r = 1; r <= tiles; r++)
+        {
+            if (tiles % r != 0 || r > N || tiles / r > M)
+                continue;
+            double perimeter = (double)N / r + (double)M / (tiles / r);
+            if (best < 0.0 || perimeter < best)
+            {
+                best = perimeter;
+                *tile_rows = r;
+                *tile_cols = tiles / r;
+            }
+        }
+        if (best >= 0.0)
+            return;
+    }
+    *tile_rows = 1;
+    *tile_cols = 1;
+}
+
+static void merge_edges(tile_t *tiles, int tile_rows, int tile_cols, int t)
+{
+    int a = t / tile_cols, b = t % tile_cols;
+    grid_t *own = &tiles[t].cells;
+
+    if (a > 0)
+    {
+        const grid_t *above = &tiles[t - tile_cols].cells;
+        const cell_t *strip = grid_row(above, above->rows);
+        cell_t *edge = grid_row(own, 0);
+        for (int j = 0; j < own->cols; j++)
+            edge[j] += strip[j];
+    }
+    if (a < tile_rows - 1)
+    {
+        const grid_t *below = &tiles[t + tile_cols].cells;
+        const cell_t *strip = grid_row(below, -1);
+        cell_t *edge = grid_row(own, own->rows - 1);
+        for (int j = 0; j < own->cols; j++)
+            edge[j] += strip[j];
+    }
+    if (b > 0)
+    {
+        const grid_t *left = &tiles[t - 1].cells;
+        for (int i = 0; i < own->rows; i++)
+            GRID_AT(own, i, 0) += GRID_AT(left, i, left->cols);
+    }
+    if (b < tile_cols - 1)
+    {
+        const grid_t *right = &tiles[t + 1].cells;
+        for (int i = 0; i < own->rows; i++)
+            GRID_AT(own, i, own->cols - 1) += GRID_AT(right, i, -1);
+    }
+}
+
+// Grains leaving a tile pile up in its border over all the passes of a sweep.
+// With narrow cells a sweep stops relaxing once a border cell passes
+// CELL_SAFE; whatever is still unstable carries over to the next sweep.
+static int strips_full(const grid_t *g)
+{
+    if (CELL_BITS == 32)
+        return 0;
+    const cell_t *top = grid_row(g, -1), *bottom = grid_row(g, g->rows);
+    for (int j = 0; j < g->cols; j++)
+        if (top[j] > CELL_SAFE || bottom[j] > CELL_SAFE)
+            return 1;
+    for (int i = 0; i < g->rows; i++)
+        if (GRID_AT(g, i, -1) > CELL_SAFE || GRID_AT(g, i, g->cols) > CELL_SAFE)
+            return 1;
+    return 0;
+}
+
+long omp_tiled_stabilize(grid_t *grid, long *sweeps, trace_t *traces)
+{
+    int N = grid->rows, M = grid->cols;
+    tile_t *tiles = NULL;
+    long *counts = NULL;
+    int tile_rows = 1, tile_cols = 1, ntiles = 1;
+    int failed = 0;
+    long total = 0;
+    long rounds = 0;
+
+    #pragma omp parallel reduction(+:total)
+    {
+        int t = omp_get_thread_num();
+        int nthreads = omp_get_num_threads();
+
+        #pragma omp single
+        {
+            choose_layout(nthreads, N, M, &tile_rows, &tile_cols);
+            ntiles = tile_rows * tile_cols;
+            tiles = calloc(ntiles, sizeof *tiles);
+            // Per-thread topple counts, double buffered by sweep parity so a
+            // thread can publish the next count while others read this one
+            counts = calloc(2 * (size_t)nthreads, sizeof *counts);
+            if (!tiles || !counts)
+                failed = 1;
+        }
+
+        tile_t *own = !failed && t < ntiles ? &tiles[t] : NULL;
+        if (own)
+        {
+            int a = t / tile_cols, b = t % tile_cols;
+            int r0 = (int)((long)a * N / tile_rows), r1 = (int)((long)(a + 1) * N / tile_rows);
+            int c0 = (int)((long)b * M / tile_cols), c1 = (int)((long)(b + 1) * M / tile_cols);
+            own->row0 = r0;
+            own->col0 = c0;
+            // Allocated and filled by the owning thread so its pages are local
+            if (grid_alloc(&own->cells, r1 - r0, c1 - c0) != 0)
+            {
+                #pragma omp atomic write
+                failed = 1;
+            }
+            else
+            {
+                for (int i = 0; i < r1 - r0; i++)
+                    memcpy(grid_row(&own->cells, i), grid_row(grid, r0 + i) + c0, (size_t)(c1 - c0) * sizeof(cell_t));
+            }
+        }
+        #pragma omp barrier
+
+        long sweep = 0;
+        int done = failed;
+        TRACE(trace_t *trace = traces ? &traces[t] : NULL);
+        while (!done)
+        {
+            TRACE(if (trace) trace_begin(trace, sweep));
+            TRACE(if (trace && own) trace_scan(trace, &own->cells, own->row0, own->col0));
+            long topples = 0;
+            if (own)
+            {
+                grid_clear_border(&own->cells);
+                long pass;
+                do
+                {
+                    pass = sandpile_relax(&own->cells, 0, own->cells.rows, 0, own->cells.cols);
+                    topples += pass;
+                } while (pass > 0 && !strips_full(&own->cells));
+            }
+            counts[(sweep & 1) * nthreads + t] = topples;
+            total += topples;
+
+            // Strips are complete once everyone has relaxed; pull the neighbours' in
+            TRACE(if (trace) trace_wait_begin(trace, TRACE_HALO));
+            #pragma omp barrier
+            if (own)
+                merge_edges(tiles, tile_rows, tile_cols, t);
+            #pragma omp barrier
+            TRACE(if (trace) trace_wait_end(trace, TRACE_HALO));
+
+            done = 1;
+            for (int k = 0; k < nthreads; k++)
+                if (counts[(sweep & 1) * nthreads + k] > 0)
+                    done = 0;
+            TRACE(if (trace) trace_end(trace, topples));
+            sweep++;
+        }
+
+        if (own)
+        {
+            if (!failed)
+                for (int i = 0; i < own->cells.rows; i++)
+                    memcpy(grid_row(grid, own->row0 + i) + own->col0, grid_row(&own->cells, i),
+                           (size_t)own->cells.cols * sizeof(cell_t));
+            grid_free(&own->cells);
+        }
+
+        #pragma omp master
+        rounds = sweep;
+    }
+
+    free(tiles);
+    free(counts);
+    if (failed)
+    {
+        fprintf(stderr, "Tile allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    *sweeps = rounds;
+    return total;
+}
@@ -0,0 +1,23 @@
+/*
+ * Atomic-free tiled OpenMP engine.
+ *
+ * Every thread owns one 2D tile of the grid and keeps it in a private bordered
+ * buffer. A sweep relaxes the tile in place until it is locally stable; grains
+ * that leave the tile pile up in the buffer's border, which acts as the
+ * thread's private ghost strips. After a barrier each thread pulls the strips
+ * its four neighbours left along the shared edges into its own edge cells, so
+ * no cell is ever written by two threads and no atomics are needed.
+ */
+
+#ifndef SANDPILE_OMP_TILED_H
+#define SANDPILE_OMP_TILED_H
+
+#include "grid.h"
+#include "trace.h"
+
+// Stabilizes grid in place with the current OpenMP thread count. Returns the
+// number of topples; *sweeps receives the number of merge rounds. traces holds
+// one trace per thread (omp_get_max_threads of them), or is NULL.
+long omp_tiled_stabilize(grid_t *grid, long *sweeps, trace_t *traces);
+
+#endif
@@ -3,6 +3,17 @@
 #include <stdbool.h>
 #include <string.h>
 #include <omp.h>
+#include "grid.h"
+#include "grid_bin.h"
+#include "options.h"
+#include "omp_tiled.h"
+#include "omp_batch.h"
+#include "omp_async.h"
+#include "omp_tasks.h"
+#include "temporal.h"
+#include "affinity.h"
+#include "stats.h"
+#include "trace.h"
 
 char *generate_output_filename(const char *input_filename)
 {
@@ -18,148 +29,325 @@ char *generate_output_filename(const char *input_filename)
     return output_filename;
 }
 
-int main(int argc, char *argv[])
+// Red/black in-place sweeps; cells of one colour only feed cells of the other,
+// so the neighbour updates need atomics but the cell itself does not. The
+// trace gets one record per sweep for the whole team.
+static long stabilize_redblack(grid_t *grid, bool use_active, long *sweep_count, trace_t *trace)
 {
-    if (argc != 5)
-    {
-        fprintf(stderr, "Usage: %s N M input.txt output.txt\n", argv[0]);
-        return EXIT_FAILURE;
-    }
-
-    int N = atoi(argv[1]);
-    int M = atoi(argv[2]);
-    const char *input_filename = argv[3];
-    const char *output_filename = argv[4];
-
-    FILE *input = fopen(input_filename, "r");
-    if (!input)
-    {
-        perror("fopen input");
-        return EXIT_FAILURE;
-    }
-
-    FILE *output = fopen(output_filename, "w");
-    if (!output)
-    {
-        perror("fopen output");
-        return EXIT_FAILURE;
-    }
+    int N = grid->rows;
+    int M = grid->cols;
 
-    int **grid = malloc(N * sizeof *grid);
-    for (int i = 0; i < N; i++)
-    {
-        grid[i] = malloc(M * sizeof *grid[i]);
-    }
-
-    for (int i = 0; i < N; i++)
-        for (int j = 0; j < M; j++)
-            fscanf(input, "%d", &grid[i][j]);
-
-    fclose(input);
+    // With use_active each sweep is restricted to the bounding box of the cells
+    // that toppled in the previous one, grown by one cell; nothing outside it
+    // can have become unstable. Red topples on the edge of that box feed black
+    // cells just outside it, so the black phase runs over the box grown to
+    // cover them as well, and the sweeps match the full ones.
+    int box_top = 0, box_bottom = N, box_left = 0, box_right = M;
 
     bool changed = true;
-    double start_time = omp_get_wtime();
+    long topples = 0;
+    long sweeps = 0;
 
     while (changed)
     {
+        TRACE(trace_begin(trace, sweeps));
+        TRACE(trace_scan(trace, grid, 0, 0));
         changed = false;
+        sweeps++;
+        int top = N, bottom = -1, left = M, right = -1;
+        TRACE(long topples_before = topples);
 
         // Red phase: Updates cells where (i + j) % 2 == 0
-        #pragma omp parallel for collapse(2) reduction(||:changed)
-        for (int i = 0; i < N; i++)
+        #pragma omp parallel for collapse(2) reduction(||:changed) reduction(+:topples) reduction(min:top, left) reduction(max:bottom, right)
+        for (int i = box_top; i < box_bottom; i++)
         {
-            for (int j = 0; j < M; j++)
+            for (int j = box_left; j < box_right; j++)
             {
                 if ((i + j) % 2 == 0) // Red cells
                 {
-                    if (grid[i][j] >= 4)
+                    cell_t *cell = &GRID_AT(grid, i, j);
+                    if (*cell >= 4)
                     {
                         changed = true;
-                        int distribute = grid[i][j] / 4;
-                        grid[i][j] %= 4;
-                        if (i > 0)
-                        {
-                            #pragma omp atomic
-                            grid[i - 1][j] += distribute;
-                        }
-                        if (i < N - 1)
-                        {
-                            #pragma omp atomic
-                            grid[i + 1][j] += distribute;
-                        }
-                        if (j > 0)
-                        {
-                            #pragma omp atomic
-                            grid[i][j - 1] += distribute;
-                        }
-                        if (j < M - 1)
-                        {
-                            #pragma omp atomic
-                            grid[i][j + 1] += distribute;
-                        }
+                        top = i < top ? i : top;
+                        bottom = i > bottom ? i : bottom;
+                        left = j < left ? j : left;
+                        right = j > right ? j : right;
+                        int distribute = *cell / 4;
+                        topples += distribute;
+                        *cell %= 4;
+                        // Grains pushed into the border fall into the sink
+                        #pragma omp atomic
+                        cell[-grid->stride] += distribute;
+                        #pragma omp atomic
+                        cell[grid->stride] += distribute;
+                        #pragma omp atomic
+                        cell[-1] += distribute;
+                        #pragma omp atomic
+                        cell[1] += distribute;
                     }
                 }
             }
         }
 
+        int black_top = box_top, black_bottom = box_bottom, black_left = box_left, black_right = box_right;
+        if (use_active && changed)
+        {
+            // Red topples lie inside the box, so it only grows where they touch it
+            black_top = top == box_top && box_top > 0 ? box_top - 1 : box_top;
+            black_bottom = bottom == box_bottom - 1 && box_bottom < N ? box_bottom + 1 : box_bottom;
+            black_left = left == box_left && box_left > 0 ? box_left - 1 : box_left;
+            black_right = right == box_right - 1 && box_right < M ? box_right + 1 : box_right;
+        }
+
         // Black phase: Updates cells where (i + j) % 2 == 1
-        #pragma omp parallel for collapse(2) reduction(||:changed)
-        for (int i = 0; i < N; i++)
+        #pragma omp parallel for collapse(2) reduction(||:changed) reduction(+:topples) reduction(min:top, left) reduction(max:bottom, right)
+        for (int i = black_top; i < black_bottom; i++)
         {
-            for (int j = 0; j < M; j++)
+            for (int j = black_left; j < black_right; j++)
             {
                 if ((i + j) % 2 == 1) // Black cells
                 {
-                    if (grid[i][j] >= 4)
+                    cell_t *cell = &GRID_AT(grid, i, j);
+                    if (*cell >= 4)
                     {
                         changed = true;
-                        int distribute = grid[i][j] / 4;
-                        grid[i][j] %= 4;
-                        if (i > 0)
-                        {
-                            #pragma omp atomic
-                            grid[i - 1][j] += distribute;
-                        }
-                        if (i < N - 1)
-                        {
-                            #pragma omp atomic
-                            grid[i + 1][j] += distribute;
-                        }
-                        if (j > 0)
-                        {
-                            #pragma omp atomic
-                            grid[i][j - 1] += distribute;
-                        }
-                        if (j < M - 1)
-                        {
-                            #pragma omp atomic
-                            grid[i][j + 1] += distribute;
-                        }
+                        top = i < top ? i : top;
+                        bottom = i > bottom ? i : bottom;
+                        left = j < left ? j : left;
+                        right = j > right ? j : right;
+                        int distribute = *cell / 4;
+                        topples += distribute;
+                        *cell %= 4;
+                        // Grains pushed into the border fall into the sink
+                        #pragma omp atomic
+                        cell[-grid->stride] += distribute;
+                        #pragma omp atomic
+                        cell[grid->stride] += distribute;
+                        #pragma omp atomic
+                        cell[-1] += distribute;
+                        #pragma omp atomic
+                        cell[1] += distribute;
                     }
                 }
             }
         }
+
+        TRACE(trace_end(trace, topples - topples_before));
+        if (use_active && changed)
+        {
+            box_top = top > 0 ? top - 1 : 0;
+            box_bottom = bottom + 2 < N ? bottom + 2 : N;
+            box_left = left > 0 ? left - 1 : 0;
+            box_right = right + 2 < M ? right + 2 : M;
+        }
+    }
+
+    *sweep_count = sweeps;
+    return topples;
+}
+
+// Jacobi passes of T sweeps over cache-sized bands shared out over the threads
+static long stabilize_temporal(grid_t *grid, int steps, long *sweep_count, trace_t *trace)
+{
+    grid_t next;
+    temporal_t temporal;
+    if (grid_alloc(&next, grid->rows, grid->cols) != 0 || temporal_init(&temporal, grid, steps) != 0)
+    {
+        fprintf(stderr, "Temporal blocking buffer allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    long topples = 0, sweeps = 0;
+    bool stable = false;
+    while (!stable)
+    {
+        // One record per pass, numbered by its first sweep
+        TRACE(trace_begin(trace, sweeps));
+        TRACE(trace_scan(trace, grid, 0, 0));
+        int passed;
+        long pass = temporal_sweep(&temporal, grid, &next, &passed, &stable);
+        topples += pass;
+        sweeps += passed;
+        grid_swap(grid, &next);
+        TRACE(trace_end(trace, pass));
+    }
+
+    temporal_free(&temporal);
+    grid_free(&next);
+    *sweep_count = sweeps;
+    return topples;
+}
+
+int main(int argc, char *argv[])
+{
+    static const char *const known_options[] = {"active", "tiled", "async", "tasks", "temporal", "affinity", "stats", "trace", "batch", "batch-output", NULL};
+    const char *batch = opt_string(argc, argv, "batch", NULL);
+    if ((argc < 5 && !batch) || opt_check(argc, argv, known_options) != 0)
+    {
+        fprintf(stderr,
+                "Usage: %s N M input.txt|input.spg output.txt [--active | --tiled | --async | --tasks | --temporal[=T]] [--stats] [--trace=path]"
+                " [--affinity=none|close|spread]\n"
+                "       %s --batch=manifest.txt|grids.spg [--batch-output=results.spg] [--stats]\n",
+                argv[0], argv[0]);
+        return EXIT_FAILURE;
     }
 
+    // --batch: many grids per process, see omp_batch.h
+    if (batch)
+    {
+        int failed = omp_batch_run(batch, opt_string(argc, argv, "batch-output", NULL), opt_flag(argc, argv, "stats"));
+        return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    int N = atoi(argv[1]);
+    int M = atoi(argv[2]);
+    const char *input_filename = argv[3];
+    const char *output_filename = argv[4];
+
+    // --tiled: atomic-free engine with one private tile per thread
+    bool use_tiled = opt_flag(argc, argv, "tiled");
+    bool use_active = opt_flag(argc, argv, "active");
+    // --async: in-place bands that exchange edge grains without barriers
+    bool use_async = opt_flag(argc, argv, "async");
+    // --tasks: one task per unstable tile, until no task is left
+    bool use_tasks = opt_flag(argc, argv, "tasks");
+    // One engine per run; --active only narrows the red/black sweeps
+    int engines = use_tiled + use_async + use_tasks + opt_flag(argc, argv, "temporal");
+    if (engines > 1 || (engines == 1 && use_active))
+    {
+        fprintf(stderr, "--tiled, --async, --tasks and --temporal do not combine with each other or --active\n");
+        return EXIT_FAILURE;
+    }
+    // --temporal[=T]: T Jacobi sweeps per pass over cache-sized bands
+    int temporal_steps = opt_flag(argc, argv, "temporal") ? (int)opt_long(argc, argv, "temporal", TEMPORAL_STEPS) : 0;
+    if (opt_flag(argc, argv, "temporal") && temporal_steps < 1)
+    {
+        fprintf(stderr, "--temporal takes a positive number of sweeps per pass\n");
+        return EXIT_FAILURE;
+    }
+
+    // --affinity=close|spread: pin the threads before the grid is touched, so
+    // each one's rows land on its own NUMA node
+    int affinity = affinity_parse(opt_string(argc, argv, "affinity", "none"));
+    if (affinity < 0)
+    {
+        fprintf(stderr, "--affinity takes none, close or spread\n");
+        return EXIT_FAILURE;
+    }
+    char placement[256];
+    if (affinity_bind_threads(affinity, placement, sizeof placement) != 0)
+        affinity = AFFINITY_NONE;
+    printf("Affinity: %s, %d threads (%s)\n", affinity_name(affinity), omp_get_max_threads(), placement);
+
+    // A binary (.spg) input is answered with a binary output
+    int binary = grid_bin_detect(input_filename);
+    FILE *input = fopen(input_filename, binary ? "rb" : "r");
+    if (!input)
+    {
+        perror("fopen input");
+        return EXIT_FAILURE;
+    }
+
+    FILE *output = fopen(output_filename, binary ? "wb" : "w");
+    if (!output)
+    {
+        perror("fopen output");
+        return EXIT_FAILURE;
+    }
+
+    // First-touched by the threads in the row order of the red/black loops
+    grid_t grid;
+    if (grid_alloc_first_touch(&grid, N, M, 1) != 0)
+    {
+        fprintf(stderr, "Grid allocation failed\n");
+        return EXIT_FAILURE;
+    }
+
+    grid_bin_header_t header = {N, M, 4, 0};
+    int status = binary ? grid_bin_read_header(input, &header) : 0;
+    if (status == 0)
+        status = binary ? grid_bin_read_cells(&grid, input, &header) : grid_read_text(&grid, input);
+    if (status != 0)
+    {
+        fprintf(stderr, "Failed to read %d x %d grid from %s\n", N, M, input_filename);
+        return EXIT_FAILURE;
+    }
+
+    fclose(input);
+
+    long sweeps = 0, tasks = 0, topples;
+
+    // --trace=path: per-round timeline of every thread for the tiled and
+    // async engines, per-sweep (per-pass for --temporal) timeline of the whole
+    // team otherwise (make TRACE=1 builds only). Tile tasks have no rounds.
+    const char *trace_path = trace_option(argc, argv);
+    if (trace_path && use_tasks)
+    {
+        fprintf(stderr, "--trace does not combine with --tasks\n");
+        return EXIT_FAILURE;
+    }
+    int ntraces = use_async || use_tiled ? omp_get_max_threads() : 1;
+    trace_t *traces = malloc((size_t)ntraces * sizeof *traces);
+    if (!traces)
+    {
+        fprintf(stderr, "Trace allocation failed\n");
+        return EXIT_FAILURE;
+    }
+    for (int k = 0; k < ntraces; k++)
+        trace_init(&traces[k], k, trace_path != NULL);
+
+    double start_time = omp_get_wtime();
+
+    if (temporal_steps)
+        topples = stabilize_temporal(&grid, temporal_steps, &sweeps, traces);
+    else if (use_tasks)
+        topples = omp_tasks_stabilize(&grid, &tasks);
+    else if (use_async)
+        topples = omp_async_stabilize(&grid, &sweeps, traces);
+    else if (use_tiled)
+        topples = omp_tiled_stabilize(&grid, &sweeps, traces);
+    else
+        topples = stabilize_redblack(&grid, use_active, &sweeps, traces);
+
     double end_time = omp_get_wtime();
     printf("OpenMP time: %f seconds\n", end_time - start_time);
+    // --stats: one JSON line in the schema shared with the other drivers
+    if (opt_flag(argc, argv, "stats"))
+    {
+        // Only the red/black and temporal engines sweep every cell per iteration
+        bool full_sweeps = !use_tasks && !use_async && !use_tiled;
+        run_stats_t stats = {"omp", N, M, 1, omp_get_max_threads(), sweeps, topples, end_time - start_time, tasks,
+                             full_sweeps};
+        stats_print(&stats, stdout);
+    }
 
-    for (int i = 0; i < N; i++)
+    if (trace_path && trace_write(trace_path, "thread", traces, ntraces) != 0)
+        fprintf(stderr, "Failed to write trace %s\n", trace_path);
+    for (int k = 0; k < ntraces; k++)
+        trace_free(&traces[k]);
+    free(traces);
+
+    // Drop the grains that were toppled into the sink
+    grid_clear_border(&grid);
+
+    if (binary)
     {
-        for (int j = 0; j < M; j++)
+        // Stable cells hold 0..3, so one byte each is enough
+        if (grid_bin_write(&grid, output, 1, header.iteration + sweeps) != 0)
         {
-            fprintf(output, "%d%s", grid[i][j], j == M - 1 ? "" : " ");
+            fprintf(stderr, "Failed to write %s\n", output_filename);
+            return EXIT_FAILURE;
         }
-        fprintf(output, "\n");
+    }
+    else
+    {
+        grid_write_text(&grid, output);
     }
 
     fclose(output);
 
-    for (int i = 0; i < N; i++)
-    {
-        free(grid[i]);
-    }
-    free(grid);
+    grid_free(&grid);
 
     return EXIT_SUCCESS;
 }
\ No newline at end of file
@@ -13,8 +13,21 @@
 #include <string.h>
 #include <png.h> // Requires libpng-dev
 #include <mpi.h>
+#include "grid.h"
+#include "grid_bin.h"
+#include "kernel.h"
+#include "active.h"
+#include "options.h"
+#include "bitslice.h"
+#include "checkpoint.h"
+#include "stats.h"
+#include "trace.h"
+#include "symmetry.h"
+#include "avalanche.h"
+#include "temporal.h"
+#include "lanes.h"
 
-void write_png(const char *filename, int **grid, int N, int M)
+void write_png(const char *filename, const grid_t *grid, int N, int M)
 {
     FILE *fp = fopen(filename, "wb");
     if (!fp)
@@ -47,7 +60,7 @@ void write_png(const char *filename, int **grid, int N, int M)
     {
         for (int x = 0; x < M; x++)
         {
-            int val = grid[y][x];
+            int val = GRID_AT(grid, y, x);
             switch (val)
             {
             case 0:
@@ -99,11 +112,70 @@ char *generate_output_filename(const char *input_filename)
     return output_filename;
 }
 
+// Resolves the grain-drop events read from drops_path ("-" for stdin) on the
+// stable grid one avalanche at a time and logs each one as a CSV line
+static void run_drops(grid_t *grid, const char *drops_path, const char *log_path)
+{
+    FILE *events = strcmp(drops_path, "-") == 0 ? stdin : fopen(drops_path, "r");
+    FILE *log = fopen(log_path, "w");
+    if (!events || !log)
+    {
+        perror(events ? "fopen avalanches" : "fopen drops");
+        exit(EXIT_FAILURE);
+    }
+
+    avalanche_t avalanche;
+    if (avalanche_init(&avalanche, grid) != 0)
+    {
+        fprintf(stderr, "Avalanche queue allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    fprintf(log, "event,drops,size,area,duration\n");
+    avalanche_drop_t *drops = NULL;
+    int capacity = 0, n;
+    long count = 0, topples = 0;
+    double seconds = 0.0;
+    while ((n = avalanche_read_event(events, &drops, &capacity)) > 0)
+    {
+        avalanche_stats_t stats;
+        double start = MPI_Wtime();
+        if (avalanche_drop(&avalanche, drops, n, &stats) != 0)
+        {
+            fprintf(stderr, "Event %ld drops grains outside the grid or piles too many on a cell\n", count + 1);
+            exit(EXIT_FAILURE);
+        }
+        seconds += MPI_Wtime() - start;
+        count++;
+        topples += stats.size;
+        fprintf(log, "%ld,%d,%ld,%ld,%ld\n", count, n, stats.size, stats.area, stats.duration);
+    }
+    if (n < 0)
+    {
+        fprintf(stderr, "Malformed event %ld in %s\n", count + 1, drops_path);
+        exit(EXIT_FAILURE);
+    }
+    printf("Avalanches: %ld events, %ld topples in %f seconds\n", count, topples, seconds);
+
+    free(drops);
+    avalanche_free(&avalanche);
+    fclose(log);
+    if (events != stdin)
+        fclose(events);
+}
+
 int main(int argc, char *argv[])
 {
-    if (argc != 5)
+    static const char *const known_options[] = {"active", "bitsliced", "checkpoint", "checkpoint-every",
+                                                "checkpoint-seconds", "restart", "stats", "trace", "symmetric", "drops",
+                                                "avalanches", "inplace", "temporal", NULL};
+    if (argc < 5 || opt_check(argc, argv, known_options) != 0)
     {
-        fprintf(stderr, "Usage: %s N M input.txt image.png\n", argv[0]);
+        fprintf(stderr,
+                "Usage: %s N M input.txt|input.spg image.png [--active] [--bitsliced] [--checkpoint=path]"
+                " [--checkpoint-every=N] [--checkpoint-seconds=T] [--restart] [--stats] [--trace=path] [--inplace] [--temporal[=T]]"
+                " [--symmetric[=hvd]] [--drops=events.txt|-] [--avalanches=path]\n",
+                argv[0]);
         return EXIT_FAILURE;
     }
 
@@ -112,7 +184,16 @@ int main(int argc, char *argv[])
     const char *input_filename = argv[3];
     const char *image_filename = argv[4];
 
-    FILE *input = fopen(input_filename, "r");
+    // --restart: load the last checkpoint instead of the input; the output is
+    // still named after the input and keeps its format
+    checkpoint_t checkpoint;
+    checkpoint_init(&checkpoint, argc, argv);
+    const char *source_filename = checkpoint.restart ? checkpoint.path : input_filename;
+
+    // A binary (.spg) input is answered with a binary output
+    int binary = grid_bin_detect(input_filename);
+    int source_binary = checkpoint.restart || binary;
+    FILE *input = fopen(source_filename, source_binary ? "rb" : "r");
     if (!input)
     {
         perror("fopen input");
@@ -120,64 +201,198 @@ int main(int argc, char *argv[])
     }
 
     char *output_filename = generate_output_filename(input_filename);
-    FILE *output = fopen(output_filename, "w");
+    FILE *output = fopen(output_filename, binary ? "wb" : "w");
     if (!output)
     {
         perror("fopen output");
         return EXIT_FAILURE;
     }
 
-    int **grid = malloc(N * sizeof *grid);
-    int **next = malloc(N * sizeof *next);
-    for (int i = 0; i < N; i++)
+    // --inplace: Gauss-Seidel passes that topple into the same cells, run on
+    // interleaved strips (lanes.h) instead of the second buffer
+    bool use_inplace = opt_flag(argc, argv, "inplace");
+    // --temporal[=T]: T sweeps per pass over cache-sized bands
+    int temporal_steps = opt_flag(argc, argv, "temporal") ? (int)opt_long(argc, argv, "temporal", TEMPORAL_STEPS) : 0;
+    if ((use_inplace || temporal_steps) && (opt_flag(argc, argv, "active") || opt_flag(argc, argv, "bitsliced") ||
+                                            opt_flag(argc, argv, "symmetric") || (use_inplace && temporal_steps)))
     {
-        grid[i] = malloc(M * sizeof *grid[i]);
-        next[i] = malloc(M * sizeof *next[i]);
+        fprintf(stderr, "--inplace and --temporal do not combine with each other, --active, --bitsliced or --symmetric\n");
+        return EXIT_FAILURE;
+    }
+    if (opt_flag(argc, argv, "temporal") && temporal_steps < 1)
+    {
+        fprintf(stderr, "--temporal takes a positive number of sweeps per pass\n");
+        return EXIT_FAILURE;
+    }
+
+    grid_t grid, next = {0};
+    if (grid_alloc(&grid, N, M) != 0 || (!use_inplace && grid_alloc(&next, N, M) != 0))
+    {
+        fprintf(stderr, "Grid allocation failed\n");
+        return EXIT_FAILURE;
     }
 
-    for (int i = 0; i < N; i++)
-        for (int j = 0; j < M; j++)
-            fscanf(input, "%d", &grid[i][j]);
+    grid_bin_header_t header = {N, M, 4, 0};
+    int status = source_binary ? grid_bin_read_header(input, &header) : 0;
+    if (status == 0)
+        status = source_binary ? grid_bin_read_cells(&grid, input, &header) : grid_read_text(&grid, input);
+    if (status != 0)
+    {
+        fprintf(stderr, "Failed to read %d x %d grid from %s\n", N, M, source_filename);
+        return EXIT_FAILURE;
+    }
 
     fclose(input);
 
+    // --symmetric[=hvd]: if the grid is mirror symmetric about its horizontal
+    // (h) or vertical (v) centre line or its diagonal (d), sweep only the
+    // fundamental domain; the full grid waits in `full` for the result
+    symmetry_t symmetry;
+    symmetry_init(&symmetry, N, M, 0);
+    grid_t full;
+    if (opt_flag(argc, argv, "symmetric"))
+    {
+        int allowed = symmetry_parse(opt_string(argc, argv, "symmetric", "hvd"));
+        if (allowed < 0 || opt_flag(argc, argv, "active") || opt_flag(argc, argv, "bitsliced"))
+        {
+            fprintf(stderr, "--symmetric takes letters h, v and d and no --active or --bitsliced\n");
+            return EXIT_FAILURE;
+        }
+        symmetry_init(&symmetry, N, M, symmetry_detect(&grid, allowed));
+        if (symmetry.flags)
+        {
+            full = grid;
+            grid_free(&next);
+            if (grid_alloc(&grid, symmetry.rows, symmetry.cols) != 0 ||
+                grid_alloc(&next, symmetry.rows, symmetry.cols) != 0)
+            {
+                fprintf(stderr, "Grid allocation failed\n");
+                return EXIT_FAILURE;
+            }
+            symmetry_fold(&symmetry, &full, &grid);
+        }
+        printf("Symmetric domain: %d x %d%s%s%s\n", symmetry.rows, symmetry.cols,
+               symmetry.flags & SYMMETRY_ROWS ? " h" : "", symmetry.flags & SYMMETRY_COLS ? " v" : "",
+               symmetry.flags & SYMMETRY_DIAGONAL ? " d" : "");
+    }
+
+    // --active: sweep only tiles that are unstable or next to unstable ones
+    bool use_active = opt_flag(argc, argv, "active");
+    active_set_t active;
+    if (use_active && active_init(&active, &grid, ACTIVE_TILE_ROWS, ACTIVE_TILE_COLS) != 0)
+    {
+        fprintf(stderr, "Active set allocation failed\n");
+        return EXIT_FAILURE;
+    }
+
+    // --bitsliced: as soon as every cell is below 8, continue on 3 bit-planes
+    // (64 cells per word); the integer sweep handles the phase before that
+    bool use_bitsliced = opt_flag(argc, argv, "bitsliced");
+    bitslice_t planes;
+    bool sliced = false;
+
+    temporal_t temporal;
+    if (temporal_steps && temporal_init(&temporal, &grid, temporal_steps) != 0)
+    {
+        fprintf(stderr, "Temporal blocking buffer allocation failed\n");
+        return EXIT_FAILURE;
+    }
+
+    lanes_t lanes;
+    if (use_inplace && lanes_init(&lanes, &grid) != 0)
+    {
+        fprintf(stderr, "Lane buffer allocation failed\n");
+        return EXIT_FAILURE;
+    }
+
+    // --trace=path: per-sweep timeline (make TRACE=1 builds only)
+    const char *trace_path = trace_option(argc, argv);
+
     bool changed = true;
+    long sweeps = 0;
+    long total_topples = 0;
     MPI_Init(&argc, &argv);
+    sandpile_kernel_init();
     // Start MPI timer
     double start_time = MPI_Wtime();
+    checkpoint_mark(&checkpoint, 0, start_time);
+    trace_t trace;
+    trace_init(&trace, 0, trace_path != NULL);
     while (changed)
     {
-        changed = false;
-        for (int i = 0; i < N; i++)
-            for (int j = 0; j < M; j++)
-                next[i][j] = 0;
+        TRACE(trace_begin(&trace, sweeps));
+        TRACE(if (!sliced && !use_inplace) trace_scan(&trace, &grid, 0, 0));
 
-        for (int i = 0; i < N; i++)
+        // Cells never climb back to 8 once all are below it, so the check
+        // only runs every few sweeps until it succeeds
+        if (use_bitsliced && !sliced && sweeps % 8 == 0 && bitslice_fits(&grid))
         {
-            for (int j = 0; j < M; j++)
+            if (bitslice_init(&planes, &grid) != 0)
             {
-                int grains = grid[i][j];
-                int keep = grains % 4;
-                int distribute = grains / 4;
-                next[i][j] += keep;
-                if (distribute > 0)
-                {
-                    changed = true;
-                    if (i > 0)
-                        next[i - 1][j] += distribute;
-                    if (i < N - 1)
-                        next[i + 1][j] += distribute;
-                    if (j > 0)
-                        next[i][j - 1] += distribute;
-                    if (j < M - 1)
-                        next[i][j + 1] += distribute;
-                }
+                fprintf(stderr, "Bit-plane allocation failed\n");
+                return EXIT_FAILURE;
             }
+            sliced = true;
         }
 
-        int **tmp = grid;
-        grid = next;
-        next = tmp;
+        // Branch-free gather sweep; the zero border stands in for the sink
+        long topples;
+        bool stable = false;
+        if (sliced)
+            topples = bitslice_sweep(&planes);
+        else if (temporal_steps)
+        {
+            // One pass counts as the sweeps it advanced; the loop adds the last
+            int passed;
+            topples = temporal_sweep(&temporal, &grid, &next, &passed, &stable);
+            sweeps += passed - 1;
+        }
+        else if (use_inplace)
+            topples = lanes_relax(&lanes);
+        else if (symmetry.flags)
+            topples = symmetry_sweep(&symmetry, &grid, &next);
+        else
+            topples = use_active ? active_sweep(&active, &grid, &next)
+                                 : sandpile_sweep(&grid, &next, 0, N, 0, M, NULL);
+        changed = topples > 0 && !stable;
+        total_topples += topples;
+        TRACE(trace_end(&trace, topples));
+
+        if (!sliced && !use_inplace)
+            grid_swap(&grid, &next);
+        sweeps++;
+
+        // A failed checkpoint costs only the protection it would have given,
+        // so the run goes on
+        if (changed && checkpoint_due(&checkpoint, sweeps, MPI_Wtime()))
+        {
+            if (sliced)
+                bitslice_store(&planes, &grid);
+            if (use_inplace)
+                lanes_store(&lanes, &grid);
+            if (symmetry.flags)
+                symmetry_unfold(&symmetry, &grid, &full);
+            if (checkpoint_save(&checkpoint, symmetry.flags ? &full : &grid, header.iteration + sweeps) != 0)
+                fprintf(stderr, "Failed to write checkpoint %s\n", checkpoint.path);
+            checkpoint_mark(&checkpoint, sweeps, MPI_Wtime());
+        }
+    }
+    if (sliced)
+    {
+        bitslice_store(&planes, &grid);
+        bitslice_free(&planes);
+    }
+    if (use_inplace)
+    {
+        lanes_store(&lanes, &grid);
+        lanes_free(&lanes);
+    }
+    if (symmetry.flags)
+    {
+        symmetry_unfold(&symmetry, &grid, &full);
+        grid_free(&grid);
+        grid_free(&next);
+        grid = full;
     }
     // end MPI timer and print time
     double end_time = MPI_Wtime();
@@ -186,28 +401,48 @@ int main(int argc, char *argv[])
     if (rank == 0)
     {
         printf("Serial time: %f seconds\n", end_time - start_time);
+        // --stats: one JSON line in the schema shared with the other drivers
+        if (opt_flag(argc, argv, "stats"))
+        {
+            run_stats_t stats = {"serial", N, M, 1, 1, sweeps, total_topples, end_time - start_time, 0, true};
+            stats_print(&stats, stdout);
+        }
     }
 
-    for (int i = 0; i < N; i++)
+    if (trace_path && trace_write(trace_path, "thread", &trace, 1) != 0)
+        fprintf(stderr, "Failed to write trace %s\n", trace_path);
+    trace_free(&trace);
+
+    // --drops=events.txt: keep the stable grid and resolve grain drops on it
+    // avalanche by avalanche; the output is the grid after the last event
+    if (opt_flag(argc, argv, "drops"))
+        run_drops(&grid, opt_string(argc, argv, "drops", "-"), opt_string(argc, argv, "avalanches", "avalanches.csv"));
+
+    if (binary)
     {
-        for (int j = 0; j < M; j++)
+        // Stable cells hold 0..3, so one byte each is enough
+        if (grid_bin_write(&grid, output, 1, header.iteration + sweeps) != 0)
         {
-            fprintf(output, "%d%s", grid[i][j], j == M - 1 ? "" : " ");
+            fprintf(stderr, "Failed to write %s\n", output_filename);
+            return EXIT_FAILURE;
         }
-        fprintf(output, "\n");
+    }
+    else
+    {
+        grid_write_text(&grid, output);
     }
 
     fclose(output);
-    write_png(image_filename, grid, N, M);
+    write_png(image_filename, &grid, N, M);
 
-    for (int i = 0; i < N; i++)
-    {
-        free(grid[i]);
-        free(next[i]);
-    }
-    free(grid);
-    free(next);
+    grid_free(&grid);
+    grid_free(&next);
+    if (use_active)
+        active_free(&active);
+    if (temporal_steps)
+        temporal_free(&temporal);
     free(output_filename);
+    checkpoint_free(&checkpoint);
 
     MPI_Finalize();
     return EXIT_SUCCESS;
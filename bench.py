@@ -0,0 +1,177 @@
+# bench.py – benchmark the serial, OpenMP and MPI drivers in one schema
+#
+# Every configuration (engine × grid size × threads × ranks) is run a few
+# times after some warmup runs. The drivers' --stats line supplies iterations
+# to convergence and total topples; the table adds the median and minimum
+# loop time and the cell-update and topple throughputs at the median. Topples
+# are the same for every engine on one grid, so topples per second compare
+# engines; an iteration is a different amount of work in each (see
+# COMMON/stats.h), so iteration counts and cell updates per second only
+# compare runs of one engine, and the latter is empty where an iteration is
+# not a sweep of every cell. Topples must agree over
+# the repetitions; the iterations of the asynchronous engines may not.
+#
+#   python bench.py --engines serial,omp,mpi --sizes 256,512 --threads 1,4 --ranks 1,4
+#
+# Build the drivers first (make in SERIAL/, OMP/ and MPI/, make hybrid for
+# the hybrid engine). Inputs come from input_grids/input_<N>.txt.
+
+from pathlib import Path
+import argparse
+import csv
+import json
+import os
+import shlex
+import shutil
+import statistics
+import subprocess
+import sys
+import tempfile
+
+ROOT = Path(__file__).resolve().parent
+BINARIES = {
+    "serial": ROOT / "SERIAL" / "sandpile",
+    "omp": ROOT / "OMP" / "sandpile_omp",
+    "mpi": ROOT / "MPI" / "sandpile",
+    "hybrid": ROOT / "MPI" / "sandpile_hybrid",
+}
+FIELDS = ["engine", "args", "rows", "cols", "ranks", "threads", "repeats",
+          "iterations", "topples", "median_s", "min_s", "cell_updates_per_s", "topples_per_s"]
+
+
+def csv_ints(text):
+    return [int(v) for v in text.split(",") if v]
+
+
+def command(engine, n, input_name, ranks, args):
+    binary = str(BINARIES[engine])
+    if engine == "serial":
+        cmd = [binary, str(n), str(n), input_name, "img.png"]
+    elif engine == "omp":
+        cmd = [binary, str(n), str(n), input_name, "out.txt"]
+    else:
+        cmd = args.mpirun + ["-np", str(ranks), binary, str(n), str(n), input_name, "-"]
+    return cmd + ["--stats"] + args.extra[engine]
+
+
+def run_once(cmd, workdir, threads):
+    env = dict(os.environ, OMP_NUM_THREADS=str(threads))
+    result = subprocess.run(cmd, cwd=workdir, env=env, capture_output=True, text=True)
+    if result.returncode != 0:
+        sys.exit(f"❌  {' '.join(cmd)} failed:\n{result.stderr}")
+    for line in result.stdout.splitlines():
+        if line.startswith("{"):
+            return json.loads(line)
+    sys.exit(f"❌  {' '.join(cmd)} printed no --stats line")
+
+
+def configurations(args):
+    for engine in args.engines:
+        for n in args.sizes:
+            threads = args.threads if engine in ("omp", "hybrid") else [1]
+            ranks = args.ranks if engine in ("mpi", "hybrid") else [1]
+            for t in threads:
+                for r in ranks:
+                    yield engine, n, t, r
+
+
+def bench(engine, n, threads, ranks, args, workdir):
+    source = args.inputs / f"input_{n}.txt"
+    if not source.exists():
+        sys.exit(f"❌  {source} not found (generate it with grid_generator.py)")
+    # The drivers name their output after the input, so run on a local copy
+    input_name = f"input_{n}.txt"
+    shutil.copy(source, workdir / input_name)
+
+    cmd = command(engine, n, input_name, ranks, args)
+    for _ in range(args.warmup):
+        run_once(cmd, workdir, threads)
+    runs = [run_once(cmd, workdir, threads) for _ in range(args.repeat)]
+
+    outcomes = {r["topples"] for r in runs}
+    if len(outcomes) > 1:
+        print(f"⚠️  {engine} N={n}: topples differ between runs: {sorted(outcomes)}",
+              file=sys.stderr)
+
+    times = [r["seconds"] for r in runs]
+    median = statistics.median(times)
+    first = runs[0]
+    cells = first["rows"] * first["cols"] * first["iterations"]
+    sweeps = first["cell_updates_per_s"] is not None
+    return {
+        "engine": engine,
+        "args": " ".join(args.extra[engine]),
+        "rows": first["rows"],
+        "cols": first["cols"],
+        "ranks": first["ranks"],
+        "threads": first["threads"],
+        "repeats": len(runs),
+        "iterations": first["iterations"],
+        "topples": first["topples"],
+        "median_s": round(median, 6),
+        "min_s": round(min(times), 6),
+        "cell_updates_per_s": round(cells / median) if sweeps and median > 0 else None,
+        "topples_per_s": round(first["topples"] / median) if median > 0 else 0,
+    }
+
+
+def write(rows, fmt, output):
+    stream = open(output, "w", newline="") if output else sys.stdout
+    if fmt == "json":
+        json.dump(rows, stream, indent=2)
+        stream.write("\n")
+    else:
+        writer = csv.DictWriter(stream, fieldnames=FIELDS)
+        writer.writeheader()
+        writer.writerows(rows)
+    if output:
+        stream.close()
+        print(f"Results saved to {output}", file=sys.stderr)
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Benchmark the sandpile drivers over sizes, threads and ranks.")
+    parser.add_argument("--engines", default="serial,omp,mpi",
+                        help="Comma separated subset of " + ",".join(BINARIES))
+    parser.add_argument("--sizes", type=csv_ints, default=[128, 256],
+                        help="Grid sizes N (N x N), e.g. 256,512")
+    parser.add_argument("--threads", type=csv_ints, default=[1, 2, 4],
+                        help="OpenMP thread counts (omp, hybrid)")
+    parser.add_argument("--ranks", type=csv_ints, default=[1, 2, 4],
+                        help="MPI rank counts (mpi, hybrid)")
+    parser.add_argument("--warmup", type=int, default=1, help="Untimed runs per configuration")
+    parser.add_argument("--repeat", type=int, default=5, help="Timed runs per configuration")
+    parser.add_argument("--inputs", type=Path, default=ROOT / "input_grids",
+                        help="Directory holding input_<N>.txt")
+    parser.add_argument("--mpirun", default="mpirun",
+                        help="Launcher command, e.g. 'mpirun --oversubscribe'")
+    for engine in BINARIES:
+        parser.add_argument(f"--{engine}-args", default="",
+                            help=f"Extra switches for the {engine} driver, e.g. '--active'")
+    parser.add_argument("--format", choices=["csv", "json"], default="csv")
+    parser.add_argument("--output", type=Path, help="Result file (default: stdout)")
+    args = parser.parse_args()
+
+    args.engines = [e for e in args.engines.split(",") if e]
+    for engine in args.engines:
+        if engine not in BINARIES:
+            sys.exit(f"❌  Unknown engine {engine}")
+        if not BINARIES[engine].exists():
+            sys.exit(f"❌  {BINARIES[engine]} not built")
+    args.mpirun = shlex.split(args.mpirun)
+    args.extra = {e: shlex.split(getattr(args, f"{e}_args")) for e in BINARIES}
+
+    rows = []
+    with tempfile.TemporaryDirectory() as tmp:
+        for engine, n, threads, ranks in configurations(args):
+            row = bench(engine, n, threads, ranks, args, Path(tmp))
+            print(f"  → {engine} N={n} ranks={ranks} threads={threads}: "
+                  f"median {row['median_s']:.4f}s, {row['topples_per_s']:.3g} topples/s",
+                  file=sys.stderr)
+            rows.append(row)
+    write(rows, args.format, args.output)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,82 @@
+# grid_convert.py – convert sandpile grids between the text and binary (.spg) formats
+#
+# The direction follows the input: a file starting with the SPG1 magic is
+# written out as text, anything else is parsed as text and written as binary.
+# See COMMON/grid_bin.h for the layout.
+
+from array import array
+from pathlib import Path
+import argparse
+import struct
+import sys
+
+MAGIC = b"SPG1"
+HEADER = struct.Struct("<4sIIIQ")
+TYPECODES = {1: "B", 2: "H", 4: "I"}
+
+
+def read_binary(path: Path):
+    with open(path, "rb") as f:
+        magic, rows, cols, cell_bytes, iteration = HEADER.unpack(f.read(HEADER.size))
+        if magic != MAGIC or cell_bytes not in TYPECODES:
+            sys.exit(f"❌  {path} is not a binary sandpile grid")
+        cells = array(TYPECODES[cell_bytes])
+        cells.fromfile(f, rows * cols)
+    if sys.byteorder != "little":
+        cells.byteswap()
+    return rows, cols, cells
+
+
+def read_text(path: Path):
+    rows = []
+    with open(path) as f:
+        for line in f:
+            if line.strip():
+                rows.append([int(v) for v in line.split()])
+    if not rows or any(len(r) != len(rows[0]) for r in rows):
+        sys.exit(f"❌  {path} is not a rectangular text grid")
+    return len(rows), len(rows[0]), [v for r in rows for v in r]
+
+
+def write_binary(path: Path, rows, cols, values, cell_bytes=None):
+    top = max(values)
+    if cell_bytes is None:
+        cell_bytes = 1 if top < 1 << 8 else 2 if top < 1 << 16 else 4
+    cells = array(TYPECODES[cell_bytes], values)
+    if sys.byteorder != "little":
+        cells.byteswap()
+    with open(path, "wb") as f:
+        f.write(HEADER.pack(MAGIC, rows, cols, cell_bytes, 0))
+        cells.tofile(f)
+
+
+def write_text(path: Path, rows, cols, cells):
+    with open(path, "w") as f:
+        for i in range(rows):
+            f.write(" ".join(map(str, cells[i * cols:(i + 1) * cols])) + "\n")
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Convert a sandpile grid between text and binary (.spg).")
+    parser.add_argument("source", type=Path, help="Grid to convert")
+    parser.add_argument("target", type=Path, nargs="?",
+                        help="Output file (default: source with .txt/.spg swapped)")
+    parser.add_argument("--cell-bytes", type=int, choices=sorted(TYPECODES),
+                        help="Cell width of a binary output "
+                             "(default: smallest that fits)")
+    args = parser.parse_args()
+
+    with open(args.source, "rb") as f:
+        binary = f.read(len(MAGIC)) == MAGIC
+
+    target = args.target or args.source.with_suffix(".txt" if binary else ".spg")
+    if binary:
+        write_text(target, *read_binary(args.source))
+    else:
+        write_binary(target, *read_text(args.source), args.cell_bytes)
+    print(f"Grid saved to {target}")
+
+
+if __name__ == "__main__":
+    main()